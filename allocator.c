@@ -0,0 +1,34 @@
+// 
+// User supplied memory allocation callbacks
+//
+// 2023, Jonathan Tainer
+//
+
+#include "allocator.h"
+#include <stdlib.h>
+
+// Callbacks are used only as a complete set
+static bool HasCallbacks(const ColliderAllocator* allocator) {
+	return allocator->malloc && allocator->realloc && allocator->free;
+}
+
+bool IsAllocatorValid(const ColliderAllocator* allocator) {
+	bool none = !allocator->malloc && !allocator->realloc && !allocator->free;
+	return none || HasCallbacks(allocator);
+}
+
+void* AllocatorMalloc(const ColliderAllocator* allocator, size_t size) {
+	if (HasCallbacks(allocator)) return allocator->malloc(size, allocator->user);
+	return malloc(size);
+}
+
+void* AllocatorRealloc(const ColliderAllocator* allocator, void* ptr, size_t size) {
+	if (HasCallbacks(allocator)) return allocator->realloc(ptr, size, allocator->user);
+	return realloc(ptr, size);
+}
+
+void AllocatorFree(const ColliderAllocator* allocator, void* ptr) {
+	if (!ptr) return;
+	if (HasCallbacks(allocator)) allocator->free(ptr, allocator->user);
+	else free(ptr);
+}
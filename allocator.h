@@ -0,0 +1,32 @@
+// 
+// User supplied memory allocation callbacks
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Set all three callbacks or none. A zero initialized allocator uses
+// malloc, realloc and free, and so does a partial set, since mixing
+// the C library with user callbacks would hand blocks to the wrong free.
+typedef struct ColliderAllocator {
+	void* (*malloc)(size_t size, void* user);
+	void* (*realloc)(void* ptr, size_t size, void* user);
+	void (*free)(void* ptr, void* user);
+	void* user;
+} ColliderAllocator;
+
+// True if all three callbacks are set or none are
+bool IsAllocatorValid(const ColliderAllocator* allocator);
+
+void* AllocatorMalloc(const ColliderAllocator* allocator, size_t size);
+
+void* AllocatorRealloc(const ColliderAllocator* allocator, void* ptr, size_t size);
+
+void AllocatorFree(const ColliderAllocator* allocator, void* ptr);
+
+#endif
@@ -0,0 +1,106 @@
+// 
+// Linear allocator for data that only lives for one step
+//
+// 2023, Jonathan Tainer
+//
+
+#include "arena.h"
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+// Overflow blocks are chained through a header in front of the data
+typedef struct OverflowBlock {
+	struct OverflowBlock* next;
+	char pad[ARENA_ALIGN - sizeof(void*)];
+} OverflowBlock;
+
+static size_t AlignSize(size_t size) {
+	return (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+Arena CreateArena(size_t capacity) {
+	return CreateArenaEx(capacity, (ColliderAllocator) { 0 });
+}
+
+Arena CreateArenaEx(size_t capacity, ColliderAllocator allocator) {
+	Arena arena = { 0 };
+	arena.allocator = allocator;
+	arena.capacity = AlignSize(capacity);
+	if (arena.capacity > 0) {
+		arena.base = AllocatorMalloc(&arena.allocator, arena.capacity);
+		arena.mallocCount++;
+	}
+	return arena;
+}
+
+static void FreeOverflow(Arena* arena) {
+	OverflowBlock* block = arena->overflow;
+	while (block) {
+		OverflowBlock* next = block->next;
+		AllocatorFree(&arena->allocator, block);
+		block = next;
+	}
+	arena->overflow = NULL;
+}
+
+void FreeArena(Arena* arena) {
+	FreeOverflow(arena);
+	AllocatorFree(&arena->allocator, arena->base);
+	*arena = (Arena) { 0 };
+}
+
+void* ArenaAlloc(Arena* arena, size_t size) {
+	size = AlignSize(size);
+	void* ptr;
+	if (arena->used + size <= arena->capacity) {
+		ptr = arena->base + arena->used;
+		arena->used += size;
+	}
+	else {
+		OverflowBlock* block = AllocatorMalloc(&arena->allocator, sizeof(OverflowBlock) + size);
+		block->next = arena->overflow;
+		arena->overflow = block;
+		arena->overflowBytes += size;
+		arena->mallocCount++;
+		ptr = block + 1;
+	}
+	arena->last = ptr;
+	arena->lastSize = size;
+	return ptr;
+}
+
+void* ArenaRealloc(Arena* arena, void* ptr, size_t oldSize, size_t newSize) {
+	if (!ptr) return ArenaAlloc(arena, newSize);
+
+	// The last allocation in the main block can simply be extended
+	char* end = (char*) ptr + arena->lastSize;
+	if (ptr == arena->last && end == arena->base + arena->used) {
+		if (newSize <= arena->lastSize) return ptr;
+		size_t extra = AlignSize(newSize) - arena->lastSize;
+		if (arena->used + extra <= arena->capacity) {
+			arena->used += extra;
+			arena->lastSize += extra;
+			return ptr;
+		}
+	}
+
+	void* moved = ArenaAlloc(arena, newSize);
+	memcpy(moved, ptr, oldSize < newSize ? oldSize : newSize);
+	return moved;
+}
+
+void ResetArena(Arena* arena) {
+	// Grow once to fit everything the last cycle asked for
+	if (arena->overflow) {
+		FreeOverflow(arena);
+		arena->capacity = AlignSize(arena->capacity + arena->overflowBytes + arena->capacity / 2);
+		AllocatorFree(&arena->allocator, arena->base);
+		arena->base = AllocatorMalloc(&arena->allocator, arena->capacity);
+		arena->mallocCount++;
+	}
+	arena->overflowBytes = 0;
+	arena->used = 0;
+	arena->last = NULL;
+	arena->lastSize = 0;
+}
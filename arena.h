@@ -0,0 +1,51 @@
+// 
+// Linear allocator for data that only lives for one step
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "allocator.h"
+
+// One contiguous block handed out front to back. Requests that do not
+// fit go to separately allocated overflow blocks, and on the next reset
+// the main block grows by that much so the same workload fits next time.
+typedef struct Arena {
+	char* base;
+	size_t capacity;
+	size_t used;
+
+	// Blocks for requests that did not fit since the last reset
+	void* overflow;
+	size_t overflowBytes;
+
+	// Most recent allocation, which can be grown in place
+	void* last;
+	size_t lastSize;
+
+	// Number of heap allocations ever made by the arena
+	int mallocCount;
+
+	ColliderAllocator allocator;
+} Arena;
+
+Arena CreateArena(size_t capacity);
+
+// Same as above, with all memory coming from the given allocator
+Arena CreateArenaEx(size_t capacity, ColliderAllocator allocator);
+
+void FreeArena(Arena* arena);
+
+// Memory is 16 byte aligned and valid until the next reset
+void* ArenaAlloc(Arena* arena, size_t size);
+
+// Grows in place if ptr was the last allocation, otherwise copies
+void* ArenaRealloc(Arena* arena, void* ptr, size_t oldSize, size_t newSize);
+
+// Releases everything at once, O(1) unless the arena overflowed
+void ResetArena(Arena* arena);
+
+#endif
@@ -75,6 +75,25 @@ Matrix GetColliderTransform(Collider* col) {
 	return MatrixMultiply(col->matRotate, col->matTranslate);
 }
 
+// Splits a rotation followed by a translation back into the two matrices
+// Updates global vertex positions
+void SetColliderTransform(Collider* col, Matrix transform) {
+	col->matTranslate = MatrixTranslate(transform.m12, transform.m13, transform.m14);
+	transform.m12 = transform.m13 = transform.m14 = 0.f;
+	col->matRotate = transform;
+	UpdateColliderGlobalVerts(col);
+}
+
+// Returns the min and max of the global verts, used by the broadphase
+BoundingBox GetColliderBounds(Collider* col) {
+	BoundingBox box = { col->vertGlobal[0], col->vertGlobal[0] };
+	for (int i = 1; i < COLLIDER_VERTEX_COUNT; i++) {
+		box.min = Vector3Min(box.min, col->vertGlobal[i]);
+		box.max = Vector3Max(box.max, col->vertGlobal[i]);
+	}
+	return box;
+}
+
 //*******************************************************************
 //		COLLISION DETECTION STUFF BEGINS HERE
 //*******************************************************************
@@ -103,6 +122,68 @@ bool TestColliderPoint(Collider* col, Vector3 point) {
 		&& point.z < max.z && point.z > min.z;
 }
 
+// Slab test in the local space of the collider
+RayCollision GetColliderRayCollision(Collider* col, Ray ray) {
+	RayCollision hit = { 0 };
+	Vector3 min = col->vertLocal[0];
+	Vector3 max = col->vertLocal[0];
+	for (int i = 1; i < COLLIDER_VERTEX_COUNT; i++) {
+		min = Vector3Min(min, col->vertLocal[i]);
+		max = Vector3Max(max, col->vertLocal[i]);
+	}
+
+	// Transform ray into local space of collider
+	Vector3 origin = Vector3Transform(ray.position, MatrixInvert(GetColliderTransform(col)));
+	Vector3 dir = Vector3Transform(ray.direction, MatrixInvert(col->matRotate));
+
+	float o[3] = { origin.x, origin.y, origin.z };
+	float d[3] = { dir.x, dir.y, dir.z };
+	float lo[3] = { min.x, min.y, min.z };
+	float hi[3] = { max.x, max.y, max.z };
+	float enter = -INFINITY, exit = INFINITY;
+	int axis = -1;
+	float sign = 0.f;
+	for (int i = 0; i < 3; i++) {
+		if (fabsf(d[i]) < 1e-12f) {
+			if (o[i] < lo[i] || o[i] > hi[i]) return hit;
+			continue;
+		}
+		float t0 = (lo[i] - o[i]) / d[i];
+		float t1 = (hi[i] - o[i]) / d[i];
+		float s = -1.f;
+		if (t0 > t1) {
+			float temp = t0;
+			t0 = t1;
+			t1 = temp;
+			s = 1.f;
+		}
+		if (t0 > enter) {
+			enter = t0;
+			axis = i;
+			sign = s;
+		}
+		exit = fminf(exit, t1);
+	}
+	if (exit < enter || exit < 0.f) return hit;
+
+	// Starting inside counts as a hit right at the origin
+	hit.hit = true;
+	if (enter < 0.f || axis < 0) {
+		hit.distance = 0.f;
+		hit.point = ray.position;
+		hit.normal = Vector3Negate(Vector3Normalize(ray.direction));
+		return hit;
+	}
+	Vector3 normal = { 0 };
+	if (axis == 0) normal.x = sign;
+	else if (axis == 1) normal.y = sign;
+	else normal.z = sign;
+	hit.distance = enter;
+	hit.point = Vector3Add(ray.position, Vector3Scale(ray.direction, enter));
+	hit.normal = Vector3Transform(normal, col->matRotate);
+	return hit;
+}
+
 // First check along each face normal
 // Then check along the cross products of the pairs of the face normals
 //
@@ -209,3 +290,282 @@ Vector3 GetCollisionCorrection(Collider* a, Collider* b) {
 
 	return Vector3Scale(overlapDir, overlapMin);
 }
+
+// Separating axis test extended to linear motion. Along each axis the
+// projections overlap during an interval of time, and the colliders
+// touch during the intersection of those intervals.
+bool SweepColliderPair(Collider* a, Vector3 disp, Collider* b, float* time, Vector3* normal) {
+	float enterMax = -INFINITY;
+	float exitMin = INFINITY;
+	Vector3 hitAxis = { 0 };
+
+	Vector3 testVec[15];
+	GetCollisionVectors(a, b, testVec);
+	for (int i = 0; i < 15; i++) {
+		// Parallel edges give a zero cross product
+		if (Vector3DotProduct(testVec[i], testVec[i]) == 0.f) continue;
+
+		Vector2 apro, bpro;
+		apro = GetColliderProjectionBounds(a, testVec[i]);
+		bpro = GetColliderProjectionBounds(b, testVec[i]);
+		float speed = Vector3DotProduct(disp, testVec[i]);
+
+		float enter, exit;
+		if (speed == 0.f) {
+			if (!BoundsOverlap(apro, bpro)) return false;
+			continue;
+		}
+		enter = (bpro.x - apro.y) / speed;
+		exit = (bpro.y - apro.x) / speed;
+		if (enter > exit) {
+			float temp = enter;
+			enter = exit;
+			exit = temp;
+		}
+
+		if (enter > enterMax) {
+			enterMax = enter;
+			hitAxis = speed > 0.f ? Vector3Negate(testVec[i]) : testVec[i];
+		}
+		exitMin = fmin(exitMin, exit);
+		if (enterMax > exitMin || enterMax > 1.f || exitMin < 0.f) return false;
+	}
+
+	*time = fmax(enterMax, 0.f);
+	*normal = hitAxis;
+	return true;
+}
+
+//*******************************************************************
+//		DISTANCE QUERIES
+//*******************************************************************
+
+// Clamp the point to the box in local space, the rotation is
+// orthonormal so its transpose is its inverse
+Vector3 GetColliderClosestPoint(Collider* col, Vector3 point) {
+	Vector3 min = col->vertLocal[0];
+	Vector3 max = col->vertLocal[0];
+	for (int i = 1; i < COLLIDER_VERTEX_COUNT; i++) {
+		min = Vector3Min(min, col->vertLocal[i]);
+		max = Vector3Max(max, col->vertLocal[i]);
+	}
+
+	Vector3 pos = { col->matTranslate.m12, col->matTranslate.m13, col->matTranslate.m14 };
+	Vector3 local = Vector3Transform(Vector3Subtract(point, pos), MatrixTranspose(col->matRotate));
+	local = Vector3Min(Vector3Max(local, min), max);
+	return Vector3Add(Vector3Transform(local, col->matRotate), pos);
+}
+
+// Vertex furthest along a direction
+static int GetColliderSupport(Collider* col, Vector3 dir) {
+	int best = 0;
+	float bestProj = Vector3DotProduct(col->vertGlobal[0], dir);
+	for (int i = 1; i < COLLIDER_VERTEX_COUNT; i++) {
+		float proj = Vector3DotProduct(col->vertGlobal[i], dir);
+		if (proj > bestProj) {
+			bestProj = proj;
+			best = i;
+		}
+	}
+	return best;
+}
+
+// Point of the Minkowski difference a - b, remembering where it came from
+typedef struct SimplexVertex {
+	Vector3 w;
+	Vector3 a;
+	Vector3 b;
+	float weight;
+} SimplexVertex;
+
+typedef struct Simplex {
+	SimplexVertex v[4];
+	int count;
+} Simplex;
+
+// Drops the vertices that do not contribute to the closest point
+static void ReduceSimplex(Simplex* s) {
+	int n = 0;
+	for (int i = 0; i < s->count; i++) {
+		if (s->v[i].weight > 0.f) s->v[n++] = s->v[i];
+	}
+	s->count = n;
+}
+
+// Closest point to the origin on a segment
+static void SolveSegment(Simplex* s) {
+	Vector3 a = s->v[0].w;
+	Vector3 ab = Vector3Subtract(s->v[1].w, a);
+	float len = Vector3DotProduct(ab, ab);
+	float t = len > 0.f ? Clamp(-Vector3DotProduct(a, ab) / len, 0.f, 1.f) : 0.f;
+	s->v[0].weight = 1.f - t;
+	s->v[1].weight = t;
+}
+
+// Closest point to the origin on a triangle, by Voronoi region
+// (Ericson, Real-Time Collision Detection, 5.1.5)
+static void SolveTriangle(SimplexVertex* v) {
+	Vector3 a = v[0].w, b = v[1].w, c = v[2].w;
+	Vector3 ab = Vector3Subtract(b, a);
+	Vector3 ac = Vector3Subtract(c, a);
+	Vector3 ap = Vector3Negate(a);
+	Vector3 bp = Vector3Negate(b);
+	Vector3 cp = Vector3Negate(c);
+	float d1 = Vector3DotProduct(ab, ap), d2 = Vector3DotProduct(ac, ap);
+	float d3 = Vector3DotProduct(ab, bp), d4 = Vector3DotProduct(ac, bp);
+	float d5 = Vector3DotProduct(ab, cp), d6 = Vector3DotProduct(ac, cp);
+	float va = d3*d6 - d5*d4, vb = d5*d2 - d1*d6, vc = d1*d4 - d3*d2;
+	float wa = 0.f, wb = 0.f, wc = 0.f;
+
+	if (d1 <= 0.f && d2 <= 0.f) wa = 1.f;
+	else if (d3 >= 0.f && d4 <= d3) wb = 1.f;
+	else if (d6 >= 0.f && d5 <= d6) wc = 1.f;
+	else if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+		wb = d1 / (d1 - d3);
+		wa = 1.f - wb;
+	}
+	else if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+		wc = d2 / (d2 - d6);
+		wa = 1.f - wc;
+	}
+	else if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f) {
+		wc = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		wb = 1.f - wc;
+	}
+	else {
+		float denom = 1.f / (va + vb + vc);
+		wb = vb * denom;
+		wc = vc * denom;
+		wa = 1.f - wb - wc;
+	}
+	v[0].weight = wa;
+	v[1].weight = wb;
+	v[2].weight = wc;
+}
+
+static Vector3 GetSimplexPoint(SimplexVertex* v, int count) {
+	Vector3 p = Vector3Zero();
+	for (int i = 0; i < count; i++) p = Vector3Add(p, Vector3Scale(v[i].w, v[i].weight));
+	return p;
+}
+
+// Closest point to the origin on a tetrahedron is on whichever face
+// separates it from the origin, returns false if the origin is inside
+static bool SolveTetrahedron(Simplex* s) {
+	static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 } };
+	float bestDist = INFINITY;
+	SimplexVertex best[3];
+	bool outside = false;
+
+	for (int f = 0; f < 4; f++) {
+		Vector3 a = s->v[faces[f][0]].w;
+		Vector3 n = Vector3CrossProduct(Vector3Subtract(s->v[faces[f][1]].w, a), Vector3Subtract(s->v[faces[f][2]].w, a));
+		float sideOrigin = -Vector3DotProduct(a, n);
+		float sideOpposite = Vector3DotProduct(Vector3Subtract(s->v[faces[f][3]].w, a), n);
+		if (sideOrigin * sideOpposite >= 0.f) continue;
+
+		outside = true;
+		SimplexVertex tri[3] = { s->v[faces[f][0]], s->v[faces[f][1]], s->v[faces[f][2]] };
+		SolveTriangle(tri);
+		Vector3 p = GetSimplexPoint(tri, 3);
+		float dist = Vector3DotProduct(p, p);
+		if (dist < bestDist) {
+			bestDist = dist;
+			best[0] = tri[0];
+			best[1] = tri[1];
+			best[2] = tri[2];
+		}
+	}
+	if (!outside) return false;
+
+	s->v[0] = best[0];
+	s->v[1] = best[1];
+	s->v[2] = best[2];
+	s->count = 3;
+	return true;
+}
+
+// Tetrahedron with almost no volume, the origin can't be reliably
+// classified as inside or outside of it
+static bool IsSimplexFlat(Simplex* s) {
+	Vector3 a = s->v[0].w;
+	Vector3 n = Vector3CrossProduct(Vector3Subtract(s->v[1].w, a), Vector3Subtract(s->v[2].w, a));
+	Vector3 ad = Vector3Subtract(s->v[3].w, a);
+	return fabsf(Vector3DotProduct(n, ad)) <= 1e-4f * Vector3Length(n) * Vector3Length(ad);
+}
+
+// Gilbert-Johnson-Keerthi on the convex hulls of the global verts
+float GetColliderDistance(Collider* a, Collider* b, Vector3* pointA, Vector3* pointB) {
+	Simplex s = { 0 };
+	s.v[0].a = a->vertGlobal[0];
+	s.v[0].b = b->vertGlobal[0];
+	s.v[0].w = Vector3Subtract(s.v[0].a, s.v[0].b);
+	s.v[0].weight = 1.f;
+	s.count = 1;
+	Vector3 v = s.v[0].w;
+	bool overlap = false;
+
+	for (int iter = 0; iter < 32; iter++) {
+		float vv = Vector3DotProduct(v, v);
+		if (vv < 1e-12f) {
+			overlap = true;
+			break;
+		}
+
+		// Furthest point of a - b towards the origin
+		Vector3 dir = Vector3Negate(v);
+		SimplexVertex next = { 0 };
+		next.a = a->vertGlobal[GetColliderSupport(a, dir)];
+		next.b = b->vertGlobal[GetColliderSupport(b, v)];
+		next.w = Vector3Subtract(next.a, next.b);
+
+		// Stop once the new point gets no closer than the current one
+		if (vv - Vector3DotProduct(v, next.w) <= 1e-4f * vv) break;
+		bool repeated = false;
+		for (int i = 0; i < s.count; i++) repeated |= Vector3Equals(s.v[i].w, next.w);
+		if (repeated) break;
+
+		// Nearly flat simplices can make things worse in single
+		// precision, in which case the previous answer is kept
+		Simplex prev = s;
+		s.v[s.count++] = next;
+		if (s.count == 2) SolveSegment(&s);
+		else if (s.count == 3) SolveTriangle(s.v);
+		else if (IsSimplexFlat(&s)) {
+			s = prev;
+			break;
+		}
+		else if (!SolveTetrahedron(&s)) {
+			overlap = true;
+			break;
+		}
+		ReduceSimplex(&s);
+		Vector3 closer = GetSimplexPoint(s.v, s.count);
+		if (Vector3DotProduct(closer, closer) >= vv) {
+			s = prev;
+			break;
+		}
+		v = closer;
+	}
+
+	Vector3 pa = Vector3Zero();
+	Vector3 pb = Vector3Zero();
+	for (int i = 0; i < s.count; i++) {
+		pa = Vector3Add(pa, Vector3Scale(s.v[i].a, s.v[i].weight));
+		pb = Vector3Add(pb, Vector3Scale(s.v[i].b, s.v[i].weight));
+	}
+	if (overlap) pb = pa;
+	if (pointA) *pointA = pa;
+	if (pointB) *pointB = pb;
+	return overlap ? 0.f : Vector3Distance(pa, pb);
+}
+
+void GetColliderDistanceBatch(Collider* a, Collider* b, int count, float* distances, Vector3* pointsA, Vector3* pointsB) {
+	for (int i = 0; i < count; i++) {
+		distances[i] = GetColliderDistance(&a[i], &b[i], pointsA ? &pointsA[i] : NULL, pointsB ? &pointsB[i] : NULL);
+	}
+}
+
+void GetColliderClosestPointBatch(Collider* col, const Vector3* points, int count, Vector3* closest) {
+	for (int i = 0; i < count; i++) closest[i] = GetColliderClosestPoint(&col[i], points[i]);
+}
@@ -43,13 +43,40 @@ void AddColliderTranslation(Collider* col, Vector3 pos);
 
 Matrix GetColliderTransform(Collider* col);
 
+// Overwrite rotation and translation from a rigid transform
+void SetColliderTransform(Collider* col, Matrix transform);
+
+// Axis-aligned box enclosing the collider in global space
+BoundingBox GetColliderBounds(Collider* col);
+
 // Test if a point in global space is inside a collider
 bool TestColliderPoint(Collider* col, Vector3 point);
 
+// Distance is in multiples of the ray direction, so normalize it to
+// get distances in world units
+RayCollision GetColliderRayCollision(Collider* col, Ray ray);
+
 // Use separating axis theorem to detect overlap
 bool TestColliderPair(Collider* a, Collider* b);
 
 // Find translation needed to resolve a collision
 Vector3 GetCollisionCorrection(Collider* a, Collider* b);
 
+// Closest point on or inside the collider to a point in global space
+Vector3 GetColliderClosestPoint(Collider* col, Vector3 point);
+
+// Separation distance between two colliders, zero if they overlap
+// Closest points on each are written if the pointers are not NULL
+float GetColliderDistance(Collider* a, Collider* b, Vector3* pointA, Vector3* pointB);
+
+// Same as above for a[i] and b[i], point arrays may be NULL
+void GetColliderDistanceBatch(Collider* a, Collider* b, int count, float* distances, Vector3* pointsA, Vector3* pointsB);
+
+// Closest point on col[i] to points[i]
+void GetColliderClosestPointBatch(Collider* col, const Vector3* points, int count, Vector3* closest);
+
+// Find the fraction of 'disp' that 'a' can move before touching 'b'
+// Normal faces away from 'b', time is zero if they already overlap
+bool SweepColliderPair(Collider* a, Vector3 disp, Collider* b, float* time, Vector3* normal);
+
 #endif
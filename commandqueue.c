@@ -0,0 +1,144 @@
+// 
+// Lock-free queue of world edits from gameplay threads
+//
+// 2023, Jonathan Tainer
+//
+
+#include "commandqueue.h"
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Sequence tells whose turn the cell is: equal to the position when a
+// producer may fill it, one past the position when the consumer may
+// take it, and a full lap further once it has been taken
+typedef struct CommandCell {
+	atomic_size_t sequence;
+	ColliderCommand command;
+} CommandCell;
+
+struct ColliderCommandQueue {
+	CommandCell* cells;
+	size_t mask;
+
+	// Allocators only promise malloc's alignment, so the queue sits
+	// inside a larger block that is freed through this pointer
+	void* block;
+	ColliderAllocator allocator;
+
+	// Producers and the consumer each get their own cache line
+	alignas(64) atomic_size_t pushPosition;
+	alignas(64) size_t popPosition;
+};
+
+ColliderCommandQueue* CreateColliderCommandQueue(int capacity) {
+	return CreateColliderCommandQueueEx(capacity, (ColliderAllocator) { 0 });
+}
+
+ColliderCommandQueue* CreateColliderCommandQueueEx(int capacity, ColliderAllocator allocator) {
+	if (!IsAllocatorValid(&allocator)) return NULL;
+	size_t size = 2;
+	while (size < (size_t) capacity) size *= 2;
+
+	size_t align = alignof(ColliderCommandQueue);
+	void* block = AllocatorMalloc(&allocator, sizeof(ColliderCommandQueue) + align - 1);
+	ColliderCommandQueue* queue = (ColliderCommandQueue*) (((uintptr_t) block + align - 1) & ~(uintptr_t) (align - 1));
+	queue->block = block;
+	queue->allocator = allocator;
+	queue->cells = AllocatorMalloc(&allocator, sizeof(CommandCell) * size);
+	queue->mask = size - 1;
+	for (size_t i = 0; i < size; i++) atomic_init(&queue->cells[i].sequence, i);
+	atomic_init(&queue->pushPosition, 0);
+	queue->popPosition = 0;
+	return queue;
+}
+
+void FreeColliderCommandQueue(ColliderCommandQueue* queue) {
+	if (!queue) return;
+	ColliderAllocator allocator = queue->allocator;
+	AllocatorFree(&allocator, queue->cells);
+	AllocatorFree(&allocator, queue->block);
+}
+
+size_t GetColliderCommandQueueBytes(ColliderCommandQueue* queue) {
+	if (!queue) return 0;
+	return sizeof(ColliderCommandQueue) + alignof(ColliderCommandQueue) - 1 + sizeof(CommandCell) * (queue->mask + 1);
+}
+
+bool PushColliderCommand(ColliderCommandQueue* queue, ColliderCommand command) {
+	size_t position = atomic_load_explicit(&queue->pushPosition, memory_order_relaxed);
+	CommandCell* cell;
+	for (;;) {
+		cell = &queue->cells[position & queue->mask];
+		size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		ptrdiff_t diff = (ptrdiff_t) sequence - (ptrdiff_t) position;
+
+		// Free cell, claim it unless another producer got there first,
+		// in which case position now holds the latest value to retry with
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&queue->pushPosition, &position, position + 1,
+				memory_order_relaxed, memory_order_relaxed)) break;
+		}
+
+		// Consumer has not taken the command from a lap ago
+		else if (diff < 0) return false;
+		else position = atomic_load_explicit(&queue->pushPosition, memory_order_relaxed);
+	}
+
+	cell->command = command;
+	atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+	return true;
+}
+
+bool PopColliderCommand(ColliderCommandQueue* queue, ColliderCommand* command) {
+	size_t position = queue->popPosition;
+	CommandCell* cell = &queue->cells[position & queue->mask];
+	size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+	if (sequence != position + 1) return false;
+
+	*command = cell->command;
+	atomic_store_explicit(&cell->sequence, position + queue->mask + 1, memory_order_release);
+	queue->popPosition = position + 1;
+	return true;
+}
+
+bool QueueAddCollider(ColliderCommandQueue* queue, Collider col, ColliderHandle* result) {
+	return PushColliderCommand(queue, (ColliderCommand) {
+		.type = COLLIDER_COMMAND_ADD, .handle = COLLIDER_HANDLE_INVALID, .collider = col, .result = result });
+}
+
+bool QueueRemoveCollider(ColliderCommandQueue* queue, ColliderHandle handle) {
+	return PushColliderCommand(queue, (ColliderCommand) { .type = COLLIDER_COMMAND_REMOVE, .handle = handle });
+}
+
+bool QueueColliderTransform(ColliderCommandQueue* queue, ColliderHandle handle, Matrix transform) {
+	return PushColliderCommand(queue, (ColliderCommand) {
+		.type = COLLIDER_COMMAND_TRANSFORM, .handle = handle, .transform = transform });
+}
+
+bool QueueColliderFilter(ColliderCommandQueue* queue, ColliderHandle handle, ColliderFilter filter) {
+	return PushColliderCommand(queue, (ColliderCommand) {
+		.type = COLLIDER_COMMAND_FILTER, .handle = handle, .filter = filter });
+}
+
+void ApplyColliderCommands(ColliderCommandQueue* queue, ColliderWorld* world) {
+	ColliderCommand command;
+	for (size_t i = 0; i <= queue->mask && PopColliderCommand(queue, &command); i++) {
+		switch (command.type) {
+		case COLLIDER_COMMAND_ADD: {
+			ColliderHandle handle = AddWorldCollider(world, command.collider);
+			if (command.result) *command.result = handle;
+			break;
+		}
+		case COLLIDER_COMMAND_REMOVE:
+			RemoveWorldCollider(world, command.handle);
+			break;
+		case COLLIDER_COMMAND_TRANSFORM:
+			SetWorldColliderTransform(world, command.handle, command.transform);
+			break;
+		case COLLIDER_COMMAND_FILTER:
+			SetWorldColliderFilter(world, command.handle, command.filter);
+			break;
+		}
+	}
+}
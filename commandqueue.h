@@ -0,0 +1,72 @@
+// 
+// Lock-free queue of world edits from gameplay threads
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include "world.h"
+
+typedef enum ColliderCommandType {
+	COLLIDER_COMMAND_ADD,
+	COLLIDER_COMMAND_REMOVE,
+	COLLIDER_COMMAND_TRANSFORM,
+	COLLIDER_COMMAND_FILTER,
+} ColliderCommandType;
+
+typedef struct ColliderCommand {
+	ColliderCommandType type;
+
+	// Target of every command except add
+	ColliderHandle handle;
+
+	union {
+		Collider collider;
+		Matrix transform;
+		ColliderFilter filter;
+	};
+
+	// Add writes the new handle here when the command is applied
+	ColliderHandle* result;
+} ColliderCommand;
+
+// Fixed size ring that any number of threads can push to while one
+// thread pops. Pushing never blocks or allocates, it fails if the ring
+// is full.
+typedef struct ColliderCommandQueue ColliderCommandQueue;
+
+// Capacity is rounded up to a power of two
+ColliderCommandQueue* CreateColliderCommandQueue(int capacity);
+
+// Same as above, with all memory coming from the given allocator, such
+// as the world's. NULL if only some of its callbacks are set.
+ColliderCommandQueue* CreateColliderCommandQueueEx(int capacity, ColliderAllocator allocator);
+
+void FreeColliderCommandQueue(ColliderCommandQueue* queue);
+
+// Bytes held by the queue, zero for NULL
+size_t GetColliderCommandQueueBytes(ColliderCommandQueue* queue);
+
+// Safe from any thread, returns false if the queue is full
+bool PushColliderCommand(ColliderCommandQueue* queue, ColliderCommand command);
+
+// Only one thread at a time, returns false if the queue is empty
+bool PopColliderCommand(ColliderCommandQueue* queue, ColliderCommand* command);
+
+// The handle is written to 'result' during the step that applies the
+// command, so only read it once that step has returned
+bool QueueAddCollider(ColliderCommandQueue* queue, Collider col, ColliderHandle* result);
+
+bool QueueRemoveCollider(ColliderCommandQueue* queue, ColliderHandle handle);
+
+bool QueueColliderTransform(ColliderCommandQueue* queue, ColliderHandle handle, Matrix transform);
+
+bool QueueColliderFilter(ColliderCommandQueue* queue, ColliderHandle handle, ColliderFilter filter);
+
+// Pop and apply commands in the order they were pushed. Stops after
+// one queue's worth so producers cannot keep the caller here forever.
+void ApplyColliderCommands(ColliderCommandQueue* queue, ColliderWorld* world);
+
+#endif
@@ -0,0 +1,140 @@
+// 
+// Precision and cost of floating origin rebasing far from zero
+//
+// 2023, Jonathan Tainer
+//
+
+#include <world.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double GetSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Two rotated boxes overlapping by about a tenth of a unit near the point
+static void PlacePair(Collider* a, Collider* b, Vector3 at, float phase) {
+	*a = CreateCollider((Vector3) { -0.5f, -0.5f, -0.5f }, (Vector3) { 0.5f, 0.5f, 0.5f });
+	*b = *a;
+	Matrix rotate = MatrixRotate((Vector3) { 0.3f, 1.f, 0.2f }, 0.4f + phase);
+	Matrix transform = rotate;
+	transform.m12 = at.x;
+	transform.m13 = at.y;
+	transform.m14 = at.z;
+	SetColliderTransform(a, transform);
+	transform.m12 = at.x + 0.9f + phase;
+	SetColliderTransform(b, transform);
+}
+
+// How the pair reaches the world: placed at its far position, placed
+// there and then rebased, or placed relative to an already rebased origin
+typedef enum PlaceMode {
+	PLACE_FAR,
+	PLACE_FAR_THEN_REBASE,
+	PLACE_AFTER_REBASE,
+} PlaceMode;
+
+// Largest difference between the correction of the pair as the world
+// stores it and the same pair placed at zero, over a few sub-millimeter
+// offsets to show jitter. The position is kept in doubles, as an
+// application tracking a large map would.
+static float GetCorrectionError(double x, PlaceMode mode) {
+	float worst = 0.f;
+	for (int i = 0; i < 16; i++) {
+		float phase = i * 0.0003f;
+		ColliderWorld* world = CreateColliderWorld(1.f);
+		if (mode == PLACE_AFTER_REBASE) RebaseColliderWorldAround(world, (Vector3) { (float) x, 0.f, (float) x }, 0.f);
+		Vector3 at = { (float) (x - world->origin.x), (float) -world->origin.y, (float) (x - world->origin.z) };
+
+		Collider a, b, refA, refB;
+		PlacePair(&a, &b, at, phase);
+		ColliderHandle ha = AddWorldCollider(world, a);
+		ColliderHandle hb = AddWorldCollider(world, b);
+		if (mode == PLACE_FAR_THEN_REBASE) RebaseColliderWorldAround(world, at, 0.f);
+
+		PlacePair(&refA, &refB, Vector3Zero(), phase);
+		Vector3 stored = GetCollisionCorrection(PeekWorldCollider(world, ha), PeekWorldCollider(world, hb));
+		Vector3 diff = Vector3Subtract(stored, GetCollisionCorrection(&refA, &refB));
+		worst = fmaxf(worst, Vector3Length(diff));
+		FreeColliderWorld(world);
+	}
+	return worst;
+}
+
+static void FillWorld(ColliderWorld* world, int count, Vector3 center) {
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		Collider col = CreateCollider((Vector3) { -0.5f, -0.5f, -0.5f }, (Vector3) { 0.5f, 0.5f, 0.5f });
+		Vector3 offset = { rand() % 40000 * 0.05f, rand() % 100 * 0.05f, rand() % 40000 * 0.05f };
+		SetColliderTranslation(&col, Vector3Add(center, offset));
+		AddWorldCollider(world, col);
+	}
+}
+
+static double TimeSteps(ColliderWorld* world, int steps) {
+	double start = GetSeconds();
+	for (int i = 0; i < steps; i++) StepColliderWorld(world);
+	return (GetSeconds() - start) * 1e3 / steps;
+}
+
+// Small boxes scattered over the ground, optionally with a 200 unit
+// slab under them, which sits alone on a coarse level of the grid
+static double TimeSlab(int count, bool slab) {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	srand(2);
+	for (int i = 0; i < count; i++) {
+		Collider col = CreateCollider((Vector3) { -0.5f, -0.5f, -0.5f }, (Vector3) { 0.5f, 0.5f, 0.5f });
+		SetColliderTranslation(&col, (Vector3) { rand() % 4000 * 0.1f - 200.f, rand() % 50 * 0.1f + 1.f, rand() % 4000 * 0.1f - 200.f });
+		AddWorldCollider(world, col);
+	}
+	if (slab) AddWorldCollider(world, CreateCollider((Vector3) { -100.f, -0.5f, -100.f }, (Vector3) { 100.f, 0.5f, 100.f }));
+	StepColliderWorld(world);
+	double time = TimeSteps(world, 5);
+	FreeColliderWorld(world);
+	return time;
+}
+
+// Usage: ./benchmark [colliders] [threads]
+int main(int argc, char** argv) {
+	int count = argc > 1 ? atoi(argv[1]) : 20000;
+	int threads = argc > 2 ? atoi(argv[2]) : 1;
+
+	printf("correction error against the same pair at zero (mm)\n");
+	printf("%12s %10s %16s %16s\n", "distance", "far", "far, rebased", "after rebase");
+	double distances[] = { 0.0, 1e3, 1e4, 1e5, 1e6 };
+	for (int i = 0; i < 5; i++) {
+		// Off the cell grid, so the rebased position is not exactly zero
+		double x = distances[i] + 0.37;
+		printf("%12.0f %10.4f %16.4f %16.4f\n", distances[i], GetCorrectionError(x, PLACE_FAR) * 1e3f,
+			GetCorrectionError(x, PLACE_FAR_THEN_REBASE) * 1e3f, GetCorrectionError(x, PLACE_AFTER_REBASE) * 1e3f);
+	}
+
+	printf("\nstep with %d small boxes\n", count);
+	printf("without a slab: %.3f ms\n", TimeSlab(count, false));
+	printf("with a slab:    %.3f ms\n", TimeSlab(count, true));
+
+	printf("\n%d colliders, %d threads\n", count, threads);
+	ColliderWorld* world = CreateColliderWorld(2.f);
+	if (threads > 1) world->pool = CreateThreadPool(threads);
+	Vector3 far = { 1e5f, 0.f, 1e5f };
+	FillWorld(world, count, far);
+	StepColliderWorld(world);
+	double farStep = TimeSteps(world, 10);
+
+	double start = GetSeconds();
+	RebaseColliderWorldAround(world, far, 0.f);
+	double rebase = (GetSeconds() - start) * 1e3;
+	double rebasedStep = TimeSteps(world, 10);
+
+	printf("step far from zero: %.3f ms\n", farStep);
+	printf("rebase:             %.3f ms\n", rebase);
+	printf("step after rebase:  %.3f ms\n", rebasedStep);
+
+	if (world->pool) FreeThreadPool(world->pool);
+	FreeColliderWorld(world);
+	return 0;
+}
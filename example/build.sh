@@ -1 +1,4 @@
 gcc -I.. -Ilighting example.c ../collider.c lighting/lighting.c -lraylib -lGL -lm -lpthread -ldl -lrt -lX11
+gcc -O2 -I.. replay.c ../record.c ../world.c ../hgrid.c ../paircache.c ../arena.c ../allocator.c ../threadpool.c ../commandqueue.c ../snapshot.c ../collider.c -lm -lpthread -o replay
+gcc -O2 -I.. benchmark.c ../world.c ../hgrid.c ../paircache.c ../arena.c ../allocator.c ../threadpool.c ../commandqueue.c ../snapshot.c ../collider.c -lm -lpthread -o benchmark
+gcc -O2 -I.. test.c ../octree.c ../query.c ../scene.c ../stream.c ../rollback.c ../history.c ../record.c ../world.c ../hgrid.c ../paircache.c ../arena.c ../allocator.c ../threadpool.c ../commandqueue.c ../snapshot.c ../collider.c -lm -lpthread -o test
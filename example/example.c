@@ -8,13 +8,161 @@
 #include <raymath.h>
 #include <collider.h>
 #include <lighting.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Fixed rate of the physics thread in threaded mode
+#define PHYSICS_RATE 120.0
 
 typedef struct RigidBody {
 	Model model;
 	Collider collider;
 } RigidBody;
 
-int main() {
+//*******************************************************************
+// Lock-free triple buffer
+//*******************************************************************
+
+// The writer fills one slot while the reader holds another, and the
+// third sits in the middle. Publishing swaps the written slot into the
+// middle, and the reader swaps it out when it is flagged as new. The
+// reader always gets the latest complete value and nobody waits.
+typedef struct TripleBuffer {
+	char* slots;
+	size_t size;
+	int write;
+	int read;
+	atomic_int middle;
+} TripleBuffer;
+
+#define TRIPLE_BUFFER_NEW 4
+
+static TripleBuffer CreateTripleBuffer(size_t size, const void* initial) {
+	TripleBuffer buffer = { malloc(size * 3), size, 0, 2, 1 };
+	for (int i = 0; i < 3; i++) memcpy(buffer.slots + size * i, initial, size);
+	return buffer;
+}
+
+static void* GetTripleBufferWrite(TripleBuffer* buffer) {
+	return buffer->slots + buffer->size * buffer->write;
+}
+
+static void PublishTripleBuffer(TripleBuffer* buffer) {
+	buffer->write = atomic_exchange(&buffer->middle, buffer->write | TRIPLE_BUFFER_NEW) & 3;
+}
+
+static const void* ReadTripleBuffer(TripleBuffer* buffer) {
+	if (atomic_load(&buffer->middle) & TRIPLE_BUFFER_NEW) {
+		buffer->read = atomic_exchange(&buffer->middle, buffer->read) & 3;
+	}
+	return buffer->slots + buffer->size * buffer->read;
+}
+
+//*******************************************************************
+// Player physics, shared by both modes
+//*******************************************************************
+
+typedef struct Physics {
+	Collider* player;
+	Collider* obstacles[3];
+	Vector3 playerVel;
+} Physics;
+
+// Movement and jumps are totals since startup, so a physics step that
+// sees several render frames' worth of input at once misses nothing
+typedef struct PhysicsInput {
+	Vector3 moved;
+	float angle;
+	int jumps;
+} PhysicsInput;
+
+// Player position before and after the step scheduled at 'time'
+typedef struct PhysicsState {
+	Vector3 prevPos;
+	Vector3 pos;
+	float angle;
+	double time;
+} PhysicsState;
+
+typedef struct PhysicsThread {
+	Physics physics;
+	TripleBuffer input;
+	TripleBuffer output;
+	atomic_bool quit;
+} PhysicsThread;
+
+static double GetSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Vector3 GetPlayerPosition(Physics* physics) {
+	return Vector3Transform(Vector3Zero(), physics->player->matTranslate);
+}
+
+static void StepPhysics(Physics* physics, Vector3 move, float angle, bool jump, float dt) {
+	// Translate and rotate player collider to follow camera target
+	AddColliderTranslation(physics->player, move);
+	SetColliderRotation(physics->player, (Vector3) { 0.f, 1.f, 0.f }, angle);
+
+	// Apply gravity:
+	Vector3* playerVel = &physics->playerVel;
+	playerVel->x = 0.f;
+	playerVel->z = 0.f;
+	playerVel->y = jump ? 20.f: playerVel->y - 0.8f;
+	playerVel->y = fmax(-20.f, playerVel->y);
+	Vector3 playerDisp = Vector3Scale(*playerVel, dt);
+	AddColliderTranslation(physics->player, playerDisp);
+
+	// Calculate the correction needed to resolve collisions between the player and all other colliders
+	// Then add the correction to the position of the player
+	// The order in which the corrections are applied can change the results
+	for (int i = 0; i < 3; i++) {
+		Vector3 corr = GetCollisionCorrection(physics->player, physics->obstacles[i]);
+		AddColliderTranslation(physics->player, corr);
+	}
+}
+
+// Steps at a fixed rate no matter how long render frames take
+static void* PhysicsMain(void* arg) {
+	PhysicsThread* thread = arg;
+	const double step = 1.0 / PHYSICS_RATE;
+	PhysicsInput last = *(const PhysicsInput*) ReadTripleBuffer(&thread->input);
+	double next = GetSeconds() + step;
+	while (!atomic_load(&thread->quit)) {
+		PhysicsInput input = *(const PhysicsInput*) ReadTripleBuffer(&thread->input);
+		Vector3 prevPos = GetPlayerPosition(&thread->physics);
+		StepPhysics(&thread->physics, Vector3Subtract(input.moved, last.moved), input.angle,
+			input.jumps != last.jumps, step);
+		last = input;
+
+		// Stamped with the time this step was scheduled for, so the render
+		// loop reaches the new position one step after it was simulated
+		PhysicsState* state = GetTripleBufferWrite(&thread->output);
+		*state = (PhysicsState) { prevPos, GetPlayerPosition(&thread->physics), input.angle, next - step };
+		PublishTripleBuffer(&thread->output);
+
+		// Drop steps after a long stall instead of trying to catch up
+		double now = GetSeconds();
+		if (now > next + 0.25) next = now;
+		if (next > now) {
+			double wait = next - now;
+			struct timespec ts = { (time_t) wait, (long) ((wait - (time_t) wait) * 1e9) };
+			nanosleep(&ts, NULL);
+		}
+		next += step;
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+
+	// Run physics on its own thread with "./a.out threaded"
+	bool threaded = argc > 1 && strcmp(argv[1], "threaded") == 0;
 
 	// Window setup
 	const int windowWidth = 1920;
@@ -61,7 +209,6 @@ int main() {
 	SetColliderRotation(&player.collider, axis, ang);
 	SetColliderTranslation(&player.collider, pos);
 	player.model.transform = GetColliderTransform(&player.collider);
-	Vector3 playerVel = Vector3Zero();
 
 	// Create block
 	dim = (Vector3) { 5.f, 5.f, 5.f };
@@ -98,46 +245,57 @@ int main() {
 	LightingAddModel(&block.model);
 	LightingAddModel(&ramp.model);
 
+	Physics physics = { &player.collider, { &block.collider, &ramp.collider, &plane.collider }, Vector3Zero() };
+	PhysicsInput input = { Vector3Zero(), 0.f, 0 };
+	PhysicsThread* physicsThread = NULL;
+	pthread_t physicsWorker;
+	if (threaded) {
+		physicsThread = malloc(sizeof(PhysicsThread));
+		physicsThread->physics = physics;
+		physicsThread->input = CreateTripleBuffer(sizeof(PhysicsInput), &input);
+		Vector3 start = GetPlayerPosition(&physics);
+		PhysicsState initial = { start, start, 0.f, GetSeconds() };
+		physicsThread->output = CreateTripleBuffer(sizeof(PhysicsState), &initial);
+		atomic_init(&physicsThread->quit, false);
+		pthread_create(&physicsWorker, NULL, PhysicsMain, physicsThread);
+	}
+
 	while (!WindowShouldClose()) {
 
 		// Using built-in camera controller because I am lazy
+		Vector3 prevTarget = camera.target;
 		UpdateCamera(&camera, CAMERA_THIRD_PERSON);
-
-		// Translate and rotate player collider to follow camera target
-		SetColliderTranslation(&player.collider, camera.target);
 		ang = atan2f(camera.position.x - camera.target.x, camera.position.z - camera.target.z);
-		axis = (Vector3) { 0.f, 1.f, 0.f };
-		SetColliderRotation(&player.collider, axis, ang);
-		
-		// Apply gravity:
-		const float speed = 5.f;
-		float dt = Clamp(GetFrameTime(), 0.f, 1.f/30.f);
-		playerVel.x = 0.f;
-		playerVel.z = 0.f;
-		playerVel.y = IsKeyPressed(KEY_SPACE) ? 20.f: playerVel.y - 0.8f;
-		playerVel.y = fmax(-20.f, playerVel.y);
-		Vector3 playerDisp = Vector3Scale(playerVel, dt);
-		AddColliderTranslation(&player.collider, playerDisp);
-		
-
-		// Calculate the correction needed to resolve collisions between the player and all other colliders
-		// Then add the correction to the position of the player
-		// The order in which the corrections are applied can change the results
-		Vector3 corr;
-		corr = GetCollisionCorrection(&player.collider, &block.collider);
-		AddColliderTranslation(&player.collider, corr);
-		corr = GetCollisionCorrection(&player.collider, &ramp.collider);
-		AddColliderTranslation(&player.collider, corr);
-		corr = GetCollisionCorrection(&player.collider, &plane.collider);
-		AddColliderTranslation(&player.collider, corr);
+
+		Vector3 playerPos;
+		if (threaded) {
+			// Hand the camera's movement to the physics thread
+			input.moved = Vector3Add(input.moved, Vector3Subtract(camera.target, prevTarget));
+			input.angle = ang;
+			if (IsKeyPressed(KEY_SPACE)) input.jumps++;
+			*(PhysicsInput*) GetTripleBufferWrite(&physicsThread->input) = input;
+			PublishTripleBuffer(&physicsThread->input);
+
+			// Draw between the last two physics steps, one step behind
+			const PhysicsState* state = ReadTripleBuffer(&physicsThread->output);
+			float alpha = Clamp((GetSeconds() - state->time) * PHYSICS_RATE, 0.f, 1.f);
+			playerPos = Vector3Lerp(state->prevPos, state->pos, alpha);
+			player.model.transform = MatrixMultiply(MatrixRotate((Vector3) { 0.f, 1.f, 0.f }, state->angle),
+				MatrixTranslate(playerPos.x, playerPos.y, playerPos.z));
+		}
+		else {
+			float dt = Clamp(GetFrameTime(), 0.f, 1.f/30.f);
+			Vector3 move = Vector3Subtract(camera.target, GetPlayerPosition(&physics));
+			StepPhysics(&physics, move, ang, IsKeyPressed(KEY_SPACE), dt);
+			playerPos = GetPlayerPosition(&physics);
+			player.model.transform = GetColliderTransform(&player.collider);
+		}
 
 		// Move camera to follow player collider
 		// (only translation, rotation and distance stay the same here)
-		Vector3 playerPos = Vector3Transform(Vector3Zero(), player.collider.matTranslate);
 		Vector3 cameraOffset = Vector3Subtract(camera.position, camera.target);
 		camera.target = playerPos;
 		camera.position = Vector3Add(camera.target, cameraOffset);
-		player.model.transform = GetColliderTransform(&player.collider);
 
 		// Render lighting depth map
 		BeginDepthMode();
@@ -161,9 +319,18 @@ int main() {
 		DrawModelWires(ramp.model, Vector3Zero(), 1.f, WHITE);
 		EndViewMode();
 		DrawFPS(10, 10);
+		DrawText(threaded ? "physics thread" : "single thread", 10, 40, 20, WHITE);
 		EndDrawing();
 	}
 
+	if (threaded) {
+		atomic_store(&physicsThread->quit, true);
+		pthread_join(physicsWorker, NULL);
+		free(physicsThread->input.slots);
+		free(physicsThread->output.slots);
+		free(physicsThread);
+	}
+
 	UnloadModel(plane.model);
 	UnloadModel(player.model);
 	UnloadModel(block.model);
@@ -0,0 +1,59 @@
+// 
+// Headless replay of a recorded session for benchmarking
+//
+// 2023, Jonathan Tainer
+//
+
+#include <record.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double GetSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Usage: ./replay <recording> [threads] [cell size]
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		printf("usage: %s <recording> [threads] [cell size]\n", argv[0]);
+		return 1;
+	}
+	int threads = argc > 2 ? atoi(argv[2]) : 1;
+	float cellSize = argc > 3 ? (float) atof(argv[3]) : 1.f;
+
+	ColliderWorld* world = CreateColliderWorld(cellSize);
+	if (threads > 1) world->pool = CreateThreadPool(threads);
+	ColliderReplay* replay = OpenColliderReplay(argv[1], world);
+	if (!replay) {
+		printf("%s is not a recording\n", argv[1]);
+		return 1;
+	}
+
+	// Only the step is timed, decoding the recording is not
+	double total = 0.0, worst = 0.0;
+	long long pairs = 0, contacts = 0;
+	while (ReplayColliderTick(replay, world)) {
+		double start = GetSeconds();
+		StepColliderWorld(world);
+		double elapsed = GetSeconds() - start;
+		total += elapsed;
+		if (elapsed > worst) worst = elapsed;
+		pairs += world->pairCount;
+		contacts += world->contactCount;
+	}
+
+	int ticks = replay->tickCount;
+	if (ticks > 0) {
+		printf("%d ticks, %d colliders at the end, %d threads\n", ticks, world->count, threads);
+		printf("step: %.3f ms average, %.3f ms worst\n", total * 1e3 / ticks, worst * 1e3);
+		printf("per step: %.1f pairs, %.1f contacts\n", (double) pairs / ticks, (double) contacts / ticks);
+	}
+
+	CloseColliderReplay(replay);
+	if (world->pool) FreeThreadPool(world->pool);
+	FreeColliderWorld(world);
+	return 0;
+}
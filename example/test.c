@@ -0,0 +1,951 @@
+// 
+// Headless checks of world behavior, exits nonzero on failure
+//
+// 2023, Jonathan Tainer
+//
+
+#include <world.h>
+#include <query.h>
+#include <scene.h>
+#include <octree.h>
+#include <commandqueue.h>
+#include <rollback.h>
+#include <history.h>
+#include <stream.h>
+#include <snapshot.h>
+#include <record.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static ColliderHandle AddBox(ColliderWorld* world, Vector3 pos) {
+	Collider col = CreateCollider((Vector3) { -0.5f, -0.5f, -0.5f }, (Vector3) { 0.5f, 0.5f, 0.5f });
+	SetColliderTranslation(&col, pos);
+	return AddWorldCollider(world, col);
+}
+
+static bool ContainsId(const int* ids, int count, int id) {
+	for (int i = 0; i < count; i++) {
+		if (ids[i] == id) return true;
+	}
+	return false;
+}
+
+// Box, sphere and frustum queries match a brute force check, through updates and removals
+static void TestOctreeQueries() {
+	Octree tree = CreateOctree((Vector3) { -16.f, -16.f, -16.f }, 32.f, 5);
+	BoundingBox boxes[64];
+	for (int i = 0; i < 64; i++) {
+		Vector3 center = { (i % 4) * 4.f - 6.f, ((i / 4) % 4) * 4.f - 6.f, (i / 16) * 4.f - 6.f };
+		float half = i % 5 == 0 ? 3.f : 0.5f;
+		boxes[i] = (BoundingBox) { Vector3SubtractValue(center, half), Vector3AddValue(center, half) };
+		OctreeInsert(&tree, i, boxes[i]);
+	}
+
+	// One object far outside of the root cell still has to be found
+	boxes[7] = (BoundingBox) { { 99.f, 0.f, 0.f }, { 100.f, 1.f, 1.f } };
+	OctreeUpdate(&tree, 7, boxes[7]);
+	OctreeRemove(&tree, 9);
+
+	int ids[64];
+	BoundingBox region = { { -7.f, -7.f, -7.f }, { -1.f, 0.f, 0.f } };
+	int count = OctreeQueryBox(&tree, region, ids, 64);
+	int expected = 0;
+	for (int i = 0; i < 64; i++) {
+		if (i == 9) continue;
+		BoundingBox b = boxes[i];
+		bool overlap = b.min.x <= region.max.x && b.max.x >= region.min.x
+			&& b.min.y <= region.max.y && b.max.y >= region.min.y
+			&& b.min.z <= region.max.z && b.max.z >= region.min.z;
+		if (overlap) expected++;
+		CHECK(ContainsId(ids, count, i) == overlap);
+	}
+	CHECK(count == expected);
+	CHECK(OctreeQueryBox(&tree, (BoundingBox) { { 98.f, 0.f, 0.f }, { 99.5f, 1.f, 1.f } }, ids, 64) == 1 && ids[0] == 7);
+
+	count = OctreeQuerySphere(&tree, (Vector3) { -6.f, -6.f, -6.f }, 1.f, ids, 64);
+	CHECK(count == 1 && ids[0] == 0);
+	CHECK(OctreeQuerySphere(&tree, (Vector3) { -6.f, -6.f, -6.f }, 1.f, ids, 0) == 1);
+
+	// Translated identity clips to the box x in [-7, -5], y and z in [-1, 1]
+	Frustum frustum = GetMatrixFrustum(MatrixTranslate(6.f, 0.f, 0.f));
+	count = OctreeQueryFrustum(&tree, frustum, ids, 64);
+	for (int i = 0; i < 64; i++) {
+		if (i == 9) continue;
+		BoundingBox b = boxes[i];
+		bool inside = b.min.x <= -5.f && b.max.x >= -7.f && b.min.y <= 1.f && b.max.y >= -1.f
+			&& b.min.z <= 1.f && b.max.z >= -1.f;
+		CHECK(ContainsId(ids, count, i) == inside);
+	}
+	CHECK(!ContainsId(ids, count, 9));
+	FreeOctree(&tree);
+}
+
+// Box queries test the collider itself, not just its bounds
+static void TestBoxQueryRotated() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	Collider col = CreateCollider((Vector3) { -1.f, -1.f, -1.f }, (Vector3) { 1.f, 1.f, 1.f });
+	SetColliderRotation(&col, (Vector3) { 0.f, 1.f, 0.f }, 0.7853982f);
+	ColliderHandle diamond = AddWorldCollider(world, col);
+
+	// Inside the bounds' corner but outside of the rotated box
+	ColliderHandle handles[4];
+	BoundingBox corner = { { 1.1f, -0.5f, 1.1f }, { 1.3f, 0.5f, 1.3f } };
+	CHECK(QueryWorldBox(world, corner, handles, 4) == 0);
+
+	BoundingBox tip = { { 1.2f, -0.5f, -0.1f }, { 1.5f, 0.5f, 0.1f } };
+	CHECK(QueryWorldBox(world, tip, handles, 4) == 1 && handles[0] == diamond);
+	FreeColliderWorld(world);
+}
+
+static void CheckSingleStay(ColliderWorld* world, ColliderHandle a, ColliderHandle b) {
+	StepColliderWorld(world);
+	CHECK(world->triggerEventCount == 1);
+	if (world->triggerEventCount != 1) return;
+	TriggerEvent event = world->triggerEvents[0];
+	CHECK(event.type == TRIGGER_STAY);
+	CHECK((event.trigger == a && event.other == b) || (event.trigger == b && event.other == a));
+}
+
+// Two overlapping triggers keep reporting stay when their slots swap
+static void TestTriggerPairOrder() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	world->reorderInterval = 0;
+	ColliderHandle filler = AddBox(world, (Vector3) { 20.f, 0.f, 0.f });
+	ColliderHandle a = AddBox(world, (Vector3) { -0.6f, 0.f, 0.f });
+	ColliderHandle b = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	SetWorldColliderTrigger(world, a, true);
+	SetWorldColliderTrigger(world, b, true);
+
+	StepColliderWorld(world);
+	CHECK(world->triggerEventCount == 1 && world->triggerEvents[0].type == TRIGGER_BEGIN);
+
+	// Last collider fills the removed one's slot, putting b ahead of a
+	RemoveWorldCollider(world, filler);
+	CHECK(world->slotHandle[0] == b);
+	CheckSingleStay(world, a, b);
+
+	// Morton order puts a ahead of b again
+	ReorderColliderWorld(world);
+	CHECK(world->slotHandle[0] == a);
+	CheckSingleStay(world, a, b);
+	FreeColliderWorld(world);
+}
+
+// Once buffers fit the scene, steps stop allocating, broadphase included
+static void TestSteadyStateMallocs() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderHandle handles[200];
+	Vector3 positions[200];
+	for (int i = 0; i < 200; i++) {
+		positions[i] = (Vector3) { (i % 20) * 0.9f, 0.f, (i / 20) * 0.9f };
+		handles[i] = AddBox(world, positions[i]);
+	}
+	CHECK(world->broadphase.mallocCount > 1);
+
+	ColliderTransformBatch batch = { .handles = handles, .positions = positions, .count = 200 };
+	for (int step = 0; step < 100; step++) {
+		for (int i = 0; i < 200; i++) positions[i].y = sinf(step * 0.1f + i) * 0.3f;
+		SetWorldTransformBatch(world, batch);
+		StepColliderWorld(world);
+		if (step >= world->reorderInterval + 1) CHECK(world->stats.mallocCount == 0);
+	}
+	FreeColliderWorld(world);
+}
+
+static int CountBoxAt(ColliderWorld* world, Vector3 center) {
+	ColliderHandle handles[4];
+	BoundingBox box = { Vector3SubtractValue(center, 0.1f), Vector3AddValue(center, 0.1f) };
+	return QueryWorldBox(world, box, handles, 4);
+}
+
+// Cached pairs keep their first step while they overlap and are gone
+// the first step they are not found, so returning starts them over
+static void TestPairCacheEviction() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderHandle a = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	ColliderHandle b = AddBox(world, (Vector3) { 0.5f, 0.f, 0.f });
+	StepColliderWorld(world);
+	PairCacheEntry* entry = PairCacheFind(&world->pairCache, a, b);
+	CHECK(entry != NULL);
+	if (!entry) return;
+	unsigned int first = entry->firstGeneration;
+	CHECK(!Vector3Equals(entry->correction, Vector3Zero()));
+
+	StepColliderWorld(world);
+	entry = PairCacheFind(&world->pairCache, b, a);
+	CHECK(entry != NULL && entry->firstGeneration == first);
+
+	SetWorldColliderTransform(world, b, MatrixTranslate(10.f, 0.f, 0.f));
+	for (int i = 0; i < 3; i++) {
+		StepColliderWorld(world);
+		CHECK(PairCacheFind(&world->pairCache, a, b) == NULL);
+		CHECK(world->pairCache.count == 0);
+	}
+
+	SetWorldColliderTransform(world, b, MatrixTranslate(0.5f, 0.f, 0.f));
+	StepColliderWorld(world);
+	entry = PairCacheFind(&world->pairCache, a, b);
+	CHECK(entry != NULL && entry->firstGeneration == world->pairCache.generation);
+	CHECK(entry != NULL && entry->firstGeneration != first);
+	FreeColliderWorld(world);
+}
+
+// Contacts between two overlapping boxes with the given filters
+static int CountFilteredContacts(ColliderFilter a, ColliderFilter b) {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	SetWorldColliderFilter(world, AddBox(world, (Vector3) { 0.f, 0.f, 0.f }), a);
+	SetWorldColliderFilter(world, AddBox(world, (Vector3) { 0.5f, 0.f, 0.f }), b);
+	StepColliderWorld(world);
+	int count = world->contactCount;
+	FreeColliderWorld(world);
+	return count;
+}
+
+// Masks and negative groups drop pairs, positive groups keep them regardless
+static void TestFilters() {
+	CHECK(CountFilteredContacts(COLLIDER_FILTER_DEFAULT, COLLIDER_FILTER_DEFAULT) == 1);
+	CHECK(CountFilteredContacts((ColliderFilter) { 1u, 2u, 0 }, (ColliderFilter) { 1u, 1u, 0 }) == 0);
+	CHECK(CountFilteredContacts((ColliderFilter) { 1u, 2u, 0 }, (ColliderFilter) { 2u, 1u, 0 }) == 1);
+	CHECK(CountFilteredContacts((ColliderFilter) { 1u, 0xFFFFFFFFu, -3 }, (ColliderFilter) { 1u, 0xFFFFFFFFu, -3 }) == 0);
+	CHECK(CountFilteredContacts((ColliderFilter) { 1u, 0xFFFFFFFFu, -3 }, (ColliderFilter) { 1u, 0xFFFFFFFFu, -4 }) == 1);
+	CHECK(CountFilteredContacts((ColliderFilter) { 1u, 0u, 2 }, (ColliderFilter) { 1u, 0u, 2 }) == 1);
+	CHECK(CountFilteredContacts((ColliderFilter) { 1u, 0u, 2 }, (ColliderFilter) { 1u, 0u, 3 }) == 0);
+}
+
+// Queries whose cell range does not fit an int scan levels directly
+static void TestUnboundedQueries() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderHandle a = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	ColliderHandle b = AddBox(world, (Vector3) { 3.f, 0.f, 0.f });
+
+	ColliderHandle handles[2];
+	float distances[2];
+	CHECK(QueryWorldNearest(world, (Vector3) { 1e10f, 0.f, 0.f }, 1, handles, distances) == 1);
+	CHECK(handles[0] == b);
+	CHECK(QueryWorldNearest(world, (Vector3) { -1e30f, 0.f, 0.f }, 2, handles, distances) == 2);
+	CHECK((handles[0] == a && handles[1] == b) || (handles[0] == b && handles[1] == a));
+
+	BoundingBox everything = { { -INFINITY, -INFINITY, -INFINITY }, { INFINITY, INFINITY, INFINITY } };
+	CHECK(QueryWorldBox(world, everything, handles, 2) == 2);
+	BoundingBox far = { { 1e20f, 0.f, 0.f }, { 1e20f + 1e13f, 1.f, 1.f } };
+	CHECK(QueryWorldBox(world, far, handles, 2) == 0);
+	FreeColliderWorld(world);
+}
+
+// A handle outlives its collider without aliasing the one that reuses its entry
+static void TestStaleHandle() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	AddBox(world, (Vector3) { 5.f, 0.f, 0.f });
+	ColliderHandle old = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	CHECK(RemoveWorldCollider(world, old));
+	ColliderHandle reused = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	CHECK((reused & COLLIDER_HANDLE_INDEX_MASK) == (old & COLLIDER_HANDLE_INDEX_MASK));
+	CHECK(reused != old);
+
+	CHECK(!IsWorldColliderValid(world, old));
+	CHECK(GetWorldCollider(world, old) == NULL);
+	CHECK(PeekWorldCollider(world, old) == NULL);
+	CHECK(!RemoveWorldCollider(world, old));
+	CHECK(IsWorldColliderValid(world, reused));
+
+	ColliderHandle handles[4];
+	BoundingBox box = { { -1.f, -1.f, -1.f }, { 1.f, 1.f, 1.f } };
+	CHECK(QueryWorldBox(world, box, handles, 4) == 1);
+	CHECK(handles[0] == reused);
+	float distances[4];
+	CHECK(QueryWorldNearest(world, Vector3Zero(), 1, handles, distances) == 1);
+	CHECK(handles[0] == reused);
+
+	ColliderHandle first[1] = { old };
+	ColliderHandle second[1] = { reused };
+	GetWorldDistanceBatch(world, NULL, first, second, 1, distances, NULL, NULL);
+	CHECK(distances[0] == -1.f);
+	FreeColliderWorld(world);
+}
+
+// Steps only refresh colliders handed out by GetWorldCollider, every
+// other way of moving one keeps the broadphase current by itself
+static void TestMovedColliders() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderHandle a = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	ColliderHandle b = AddBox(world, (Vector3) { 10.f, 0.f, 0.f });
+	ColliderHandle child = AddBox(world, (Vector3) { 0.f, 2.f, 0.f });
+	ColliderHandle gone = AddBox(world, (Vector3) { 20.f, 0.f, 0.f });
+	CHECK(SetWorldColliderParent(world, child, a));
+	StepColliderWorld(world);
+
+	SetWorldColliderTransform(world, b, MatrixTranslate(5.f, 0.f, 0.f));
+	CHECK(CountBoxAt(world, (Vector3) { 5.f, 0.f, 0.f }) == 1);
+	CHECK(CountBoxAt(world, (Vector3) { 10.f, 0.f, 0.f }) == 0);
+
+	SetColliderTranslation(GetWorldCollider(world, a), (Vector3) { -5.f, 0.f, 0.f });
+	SetColliderTranslation(GetWorldCollider(world, a), (Vector3) { -6.f, 0.f, 0.f });
+	SetColliderTranslation(GetWorldCollider(world, gone), (Vector3) { 30.f, 0.f, 0.f });
+	RemoveWorldCollider(world, gone);
+	CHECK(CountBoxAt(world, (Vector3) { -6.f, 0.f, 0.f }) == 0);
+	StepColliderWorld(world);
+	CHECK(world->movedCount == 0);
+	CHECK(CountBoxAt(world, (Vector3) { -6.f, 0.f, 0.f }) == 1);
+	CHECK(CountBoxAt(world, (Vector3) { 0.f, 0.f, 0.f }) == 0);
+
+	// Moving a parent through GetWorldCollider leaves its children behind
+	CHECK(CountBoxAt(world, (Vector3) { 0.f, 2.f, 0.f }) == 1);
+	SetWorldColliderTransform(world, a, MatrixTranslate(3.f, 0.f, 0.f));
+	StepColliderWorld(world);
+	CHECK(CountBoxAt(world, (Vector3) { 3.f, 2.f, 0.f }) == 1);
+	CHECK(CountBoxAt(world, (Vector3) { 0.f, 2.f, 0.f }) == 0);
+	FreeColliderWorld(world);
+}
+
+static bool MatricesNear(Matrix a, Matrix b, float tolerance) {
+	const float* x = &a.m0;
+	const float* y = &b.m0;
+	for (int i = 0; i < 16; i++) {
+		if (fabsf(x[i] - y[i]) > tolerance) return false;
+	}
+	return true;
+}
+
+// Position-only batches move an attached collider without turning it
+static void TestBatchAttachedRotation() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderHandle parent = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	ColliderHandle child = AddBox(world, (Vector3) { 0.f, 2.f, 0.f });
+	SetWorldColliderTransform(world, parent, MatrixRotate((Vector3) { 0.f, 1.f, 0.f }, PI / 2.f));
+	CHECK(SetWorldColliderParent(world, child, parent));
+	StepColliderWorld(world);
+	Matrix rotation = PeekWorldCollider(world, child)->matRotate;
+
+	for (int i = 1; i <= 3; i++) {
+		Vector3 position = { 0.f, 2.f, (float) i };
+		SetWorldTransformBatch(world, (ColliderTransformBatch) { .handles = &child, .positions = &position, .count = 1 });
+		StepColliderWorld(world);
+		Collider* col = PeekWorldCollider(world, child);
+		CHECK(MatricesNear(col->matRotate, rotation, 1e-5f));
+		CHECK(fabsf(col->matTranslate.m12 - i) < 1e-4f);
+	}
+	FreeColliderWorld(world);
+}
+
+// Snapshots are read through PeekWorldCollider, GetWorldCollider refuses them
+static void TestSnapshotColliders() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderHandle a = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	EnableWorldSnapshots(world);
+	SetWorldColliderTransform(world, a, MatrixTranslate(4.f, 0.f, 0.f));
+	StepColliderWorld(world);
+
+	ColliderWorld* snapshot = AcquireWorldSnapshot(world);
+	CHECK(snapshot != NULL);
+	if (snapshot) {
+		Collider* col = PeekWorldCollider(snapshot, a);
+		CHECK(col != NULL && fabsf(col->matTranslate.m12 - 4.f) < 1e-5f);
+		CHECK(GetWorldCollider(snapshot, a) == NULL);
+		ReleaseWorldSnapshot(world, snapshot);
+	}
+	FreeColliderWorld(world);
+}
+
+// Allocator that keeps count of live blocks
+typedef struct CountingAllocator {
+	int live;
+	int total;
+} CountingAllocator;
+
+static void* CountingMalloc(size_t size, void* user) {
+	CountingAllocator* counter = user;
+	counter->live++;
+	counter->total++;
+	return malloc(size);
+}
+
+static void* CountingRealloc(void* ptr, size_t size, void* user) {
+	CountingAllocator* counter = user;
+	if (!ptr) counter->live++;
+	counter->total++;
+	return realloc(ptr, size);
+}
+
+static void CountingFree(void* ptr, void* user) {
+	CountingAllocator* counter = user;
+	counter->live--;
+	free(ptr);
+}
+
+// Command queues share the world's allocator and show up in its memory report
+static void TestCommandQueueAllocator() {
+	CountingAllocator counter = { 0 };
+	ColliderAllocator allocator = { CountingMalloc, CountingRealloc, CountingFree, &counter };
+	ColliderWorld* world = CreateColliderWorldEx(1.f, allocator);
+	int worldBlocks = counter.total;
+	world->commands = CreateColliderCommandQueueEx(16, world->allocator);
+	CHECK(world->commands != NULL);
+	CHECK(counter.total > worldBlocks);
+	CHECK(GetColliderWorldMemory(world).commands >= 16 * sizeof(ColliderCommand));
+
+	Collider col = CreateCollider((Vector3) { -0.5f, -0.5f, -0.5f }, (Vector3) { 0.5f, 0.5f, 0.5f });
+	ColliderHandle handle = COLLIDER_HANDLE_INVALID;
+	CHECK(QueueAddCollider(world->commands, col, &handle));
+	StepColliderWorld(world);
+	CHECK(IsWorldColliderValid(world, handle));
+
+	FreeColliderCommandQueue(world->commands);
+	world->commands = NULL;
+	CHECK(GetColliderWorldMemory(world).commands == 0);
+	FreeColliderWorld(world);
+	CHECK(counter.live == 0);
+
+	ColliderAllocator partial = { CountingMalloc, NULL, NULL, &counter };
+	CHECK(CreateColliderCommandQueueEx(16, partial) == NULL);
+}
+
+// Allocator that keeps count of live bytes in a header before each block
+typedef struct ByteCountingAllocator {
+	size_t live;
+} ByteCountingAllocator;
+
+#define BYTE_COUNT_HEADER 16
+
+static void* ByteCountingRealloc(void* ptr, size_t size, void* user) {
+	ByteCountingAllocator* counter = user;
+	char* block = ptr ? (char*) ptr - BYTE_COUNT_HEADER : NULL;
+	if (block) counter->live -= *(size_t*) block;
+	block = realloc(block, size + BYTE_COUNT_HEADER);
+	*(size_t*) block = size;
+	counter->live += size;
+	return block + BYTE_COUNT_HEADER;
+}
+
+static void* ByteCountingMalloc(size_t size, void* user) {
+	return ByteCountingRealloc(NULL, size, user);
+}
+
+static void ByteCountingFree(void* ptr, void* user) {
+	if (!ptr) return;
+	ByteCountingAllocator* counter = user;
+	char* block = (char*) ptr - BYTE_COUNT_HEADER;
+	counter->live -= *(size_t*) block;
+	free(block);
+}
+
+// The memory report adds up to what the world holds from its allocator
+static void TestMemoryReport(ThreadPool* pool) {
+	ByteCountingAllocator counter = { 0 };
+	ColliderAllocator allocator = { ByteCountingMalloc, ByteCountingRealloc, ByteCountingFree, &counter };
+	ColliderWorld* world = CreateColliderWorldEx(1.f, allocator);
+	CHECK(GetColliderWorldMemory(world).total == counter.live);
+
+	world->pool = pool;
+	world->commands = CreateColliderCommandQueueEx(64, allocator);
+	EnableWorldSnapshots(world);
+	ColliderHandle handles[300];
+	for (int i = 0; i < 300; i++) handles[i] = AddBox(world, (Vector3) { (i % 20) * 0.8f, 0.f, (i / 20) * 0.8f });
+	CHECK(SetWorldColliderParent(world, handles[1], handles[0]));
+	for (int i = 0; i < 3; i++) {
+		SetColliderTranslation(GetWorldCollider(world, handles[i]), (Vector3) { i * 0.5f, 0.f, 0.f });
+		StepColliderWorld(world);
+	}
+
+	ColliderMemoryReport report = GetColliderWorldMemory(world);
+	CHECK(report.total == counter.live);
+	CHECK(report.colliders > 0 && report.shapes > 0 && report.broadphase > 0 && report.pairCache > 0);
+	CHECK(report.scratch > 0 && report.snapshots > 0 && report.commands > 0);
+	CHECK(report.total == report.colliders + report.shapes + report.broadphase + report.pairCache
+		+ report.scratch + report.snapshots + report.commands);
+
+	FreeColliderCommandQueue(world->commands);
+	world->commands = NULL;
+	FreeColliderWorld(world);
+	CHECK(counter.live == 0);
+}
+
+static void MoveRollbackBoxes(ColliderWorld* world, ColliderHandle* handles, int count, int step) {
+	Vector3 positions[32];
+	for (int i = 0; i < count; i++) {
+		positions[i] = (Vector3) { (i % 8) * 0.8f + sinf(step * 0.7f + i) * 0.4f, 0.f, (i / 8) * 0.8f };
+	}
+	SetWorldTransformBatch(world, (ColliderTransformBatch) { .handles = handles, .positions = positions, .count = count });
+}
+
+// Restoring a frame and stepping again reproduces the original run
+static void TestRollbackRoundTrip() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	world->checksumEnabled = true;
+	world->reorderInterval = 3;
+	ColliderHandle handles[32];
+	for (int i = 0; i < 32; i++) handles[i] = AddBox(world, (Vector3) { (i % 8) * 0.8f, 0.f, (i / 8) * 0.8f });
+	SetWorldColliderTrigger(world, handles[5], true);
+
+	ColliderRollback rollback = CreateColliderRollback(world, 4);
+	unsigned long long checksums[8];
+	for (int step = 0; step < 8; step++) {
+		MoveRollbackBoxes(world, handles, 32, step);
+		StepColliderWorld(world);
+		checksums[step] = world->stats.checksum;
+		SaveWorldFrame(&rollback, world, step);
+	}
+	CHECK(!RestoreWorldFrame(&rollback, world, 2));
+
+	CHECK(RestoreWorldFrame(&rollback, world, 5));
+	for (int step = 6; step < 8; step++) {
+		MoveRollbackBoxes(world, handles, 32, step);
+		ResimulateColliderWorld(world);
+		CHECK(world->stats.checksum == checksums[step]);
+	}
+
+	RemoveWorldCollider(world, handles[3]);
+	CHECK(RestoreWorldFrame(&rollback, world, 7));
+	CHECK(IsWorldColliderValid(world, handles[3]));
+	FreeColliderRollback(&rollback);
+	FreeColliderWorld(world);
+}
+
+// Rewound queries place colliders between recorded ticks and test them exactly
+static void TestHistoryQueries() {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	Collider col = CreateCollider((Vector3) { -1.f, -1.f, -1.f }, (Vector3) { 1.f, 1.f, 1.f });
+	SetColliderRotation(&col, (Vector3) { 0.f, 1.f, 0.f }, 0.7853982f);
+	ColliderHandle diamond = AddWorldCollider(world, col);
+
+	ColliderHistory history = CreateColliderHistory(world, 4);
+	RecordColliderHistory(&history, world, 0);
+	Matrix transform = GetColliderTransform(PeekWorldCollider(world, diamond));
+	transform.m12 = 10.f;
+	SetWorldColliderTransform(world, diamond, transform);
+	RecordColliderHistory(&history, world, 1);
+
+	// Inside the bounds' corner but outside of the rotated box
+	ColliderHandle handles[4];
+	BoundingBox corner = { { 1.1f, -0.5f, 1.1f }, { 1.3f, 0.5f, 1.3f } };
+	BoundingBox tip = { { 1.2f, -0.5f, -0.1f }, { 1.5f, 0.5f, 0.1f } };
+	CHECK(QueryHistoryBox(&history, world, 0.f, corner, handles, 4) == 0);
+	CHECK(QueryHistoryBox(&history, world, 0.f, tip, handles, 4) == 1 && handles[0] == diamond);
+	CHECK(QueryHistoryBox(&history, world, 1.f, tip, handles, 4) == 0);
+	CHECK(QueryHistoryBox(&history, world, 7.f, tip, handles, 4) == -1);
+
+	BoundingBox halfway = { Vector3Add(tip.min, (Vector3) { 5.f, 0.f, 0.f }), Vector3Add(tip.max, (Vector3) { 5.f, 0.f, 0.f }) };
+	CHECK(QueryHistoryBox(&history, world, 0.5f, halfway, handles, 4) == 1);
+
+	Collider past;
+	CHECK(GetHistoryCollider(&history, world, diamond, 0.25f, &past));
+	CHECK(fabsf(past.matTranslate.m12 - 2.5f) < 1e-4f);
+
+	ColliderHandle hitHandle = COLLIDER_HANDLE_INVALID;
+	RayCollision hit = { 0 };
+	Ray ray = { { -5.f, 0.f, 0.f }, { 1.f, 0.f, 0.f } };
+	CHECK(RaycastHistory(&history, world, 0.f, ray, 100.f, &hitHandle, &hit));
+	CHECK(hitHandle == diamond && fabsf(hit.distance - (5.f - 1.4142135f)) < 1e-3f);
+	CHECK(!RaycastHistory(&history, world, 0.f, ray, 3.f, &hitHandle, &hit));
+	FreeColliderHistory(&history);
+	FreeColliderWorld(world);
+}
+
+// Updates until every chunk has settled, none may go over the budget
+static void SettleStreamer(ColliderStreamer* streamer, Vector3 focus) {
+	for (int i = 0; i < 100; i++) {
+		CHECK(UpdateColliderStreamer(streamer, focus) <= streamer->budget);
+		if (IsColliderStreamerIdle(streamer)) break;
+	}
+	CHECK(IsColliderStreamerIdle(streamer));
+}
+
+// Resident colliders match the scene's, moved by the world's origin
+static void CheckStreamedColliders(ColliderStreamer* streamer, bool nearSide) {
+	ColliderScene* scene = streamer->scene;
+	ColliderWorld* world = streamer->world;
+	for (int i = 0; i < scene->instanceCount; i++) {
+		Collider* stored = PeekWorldCollider(&scene->world, scene->world.slotHandle[i]);
+		bool near = stored->matTranslate.m12 < 50.f;
+		ColliderHandle handle = streamer->handles[i];
+		CHECK(IsWorldColliderValid(world, handle) == (near == nearSide));
+		Collider* col = PeekWorldCollider(world, handle);
+		if (!col) continue;
+		CHECK(fabsf(col->matTranslate.m12 + (float) world->origin.x - stored->matTranslate.m12) < 1e-4f);
+	}
+}
+
+// Chunks stream in and out around the focus, a budget's worth at a time
+static void TestSceneStreaming() {
+	const char* path = "stream.scene";
+	SceneShape shape = { { -0.4f, -0.4f, -0.4f }, { 0.4f, 0.4f, 0.4f } };
+	SceneLayer layer = { "default", { 1, 0xFFFFFFFF, 0 } };
+	SceneInstance instances[80];
+	for (int i = 0; i < 80; i++) {
+		float x = (i % 8) * 1.f + (i < 40 ? 0.f : 100.f);
+		instances[i] = (SceneInstance) { 0, 0, { x, 0.f, (i % 40 / 8) * 1.f }, QuaternionIdentity() };
+	}
+	CHECK(SaveColliderScene(path, 1.f, 4.f, &shape, 1, instances, 80, &layer, 1));
+	ColliderScene* scene = LoadColliderScene(path);
+	CHECK(scene != NULL);
+	if (!scene) return;
+	CHECK(scene->chunkCount > 2);
+
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderStreamer streamer = CreateColliderStreamer(scene, world, 10.f, 20.f, 16);
+	CHECK(UpdateColliderStreamer(&streamer, Vector3Zero()) == 16);
+	CHECK(world->count == 16);
+	SettleStreamer(&streamer, Vector3Zero());
+	CHECK(world->count == 40);
+	CheckStreamedColliders(&streamer, true);
+
+	// Far side comes in, near side leaves and its pages are evicted, then
+	// read back from the file when it returns
+	SettleStreamer(&streamer, (Vector3) { 100.f, 0.f, 0.f });
+	CHECK(world->count == 40);
+	CheckStreamedColliders(&streamer, false);
+
+	RebaseColliderWorld(world, (Vector3) { 100.f, 0.f, 0.f });
+	CHECK(UpdateColliderStreamer(&streamer, Vector3Zero()) == 0);
+	SettleStreamer(&streamer, (Vector3) { -100.f, 0.f, 0.f });
+	CHECK(world->count == 40);
+	CheckStreamedColliders(&streamer, true);
+	StepColliderWorld(world);
+	CHECK(world->contactCount == 0);
+
+	FreeColliderStreamer(&streamer);
+	FreeColliderWorld(world);
+	UnloadColliderScene(scene);
+	remove(path);
+}
+
+#define RECORDED_BOXES 16
+
+// Moves, replaces and refilters boxes the same way every run, so a world
+// driven alongside a replay holds what the recording should reproduce
+static void DriveRecordedWorld(ColliderWorld* world, ColliderHandle* handles, int tick) {
+	for (int i = 0; i < RECORDED_BOXES; i++) {
+		if (i % 3 == tick % 3) continue;
+		Matrix rotation = MatrixRotate((Vector3) { 0.f, 1.f, 0.f }, tick * 0.1f + i);
+		Matrix translation = MatrixTranslate(i * 1.5f + sinf(tick * 0.2f), 0.f, cosf(tick * 0.3f + i));
+		SetWorldColliderTransform(world, handles[i], MatrixMultiply(rotation, translation));
+	}
+	if (tick % 5 == 4) {
+		int i = tick % RECORDED_BOXES;
+		RemoveWorldCollider(world, handles[i]);
+		handles[i] = AddBox(world, (Vector3) { i * 1.5f, 0.5f, 0.f });
+	}
+	if (tick % 3 == 2) {
+		ColliderFilter filter = { 1u << (tick % 4), 0xFFFFFFFFu, tick % 2 ? -1 : 0 };
+		SetWorldColliderFilter(world, handles[tick % RECORDED_BOXES], filter);
+	}
+	if (tick % 7 == 6) SetWorldColliderTrigger(world, handles[tick * 3 % RECORDED_BOXES], true);
+}
+
+static ColliderWorld* CreateRecordedWorld(ColliderHandle* handles) {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	for (int i = 0; i < RECORDED_BOXES; i++) handles[i] = AddBox(world, (Vector3) { i * 1.5f, 0.f, 0.f });
+	return world;
+}
+
+// A replay reproduces every tick of a recording, within its quantization
+static void TestRecordReplay() {
+	const char* path = "test.rec";
+	const float precision = 0.001f;
+	ColliderHandle handles[RECORDED_BOXES];
+	ColliderWorld* world = CreateRecordedWorld(handles);
+	ColliderRecorder* recorder = OpenColliderRecorder(path, world, precision);
+	CHECK(recorder != NULL);
+	if (!recorder) return;
+	for (int tick = 0; tick < 50; tick++) {
+		DriveRecordedWorld(world, handles, tick);
+		StepColliderWorld(world);
+		CHECK(RecordColliderTick(recorder, world));
+	}
+	CloseColliderRecorder(recorder);
+	FreeColliderWorld(world);
+
+	world = CreateRecordedWorld(handles);
+	ColliderWorld* replayWorld = CreateColliderWorld(1.f);
+	ColliderReplay* replay = OpenColliderReplay(path, replayWorld);
+	CHECK(replay != NULL);
+	int contacts = 0;
+	for (int tick = 0; replay && tick < 50; tick++) {
+		DriveRecordedWorld(world, handles, tick);
+		StepColliderWorld(world);
+		CHECK(ReplayColliderTick(replay, replayWorld));
+		StepColliderWorld(replayWorld);
+		CHECK(replayWorld->count == world->count);
+		CHECK(replayWorld->contactCount == world->contactCount);
+		contacts += world->contactCount;
+
+		// Rotations are quantized too, so vertices may be a little past a position step
+		for (int i = 0; i < RECORDED_BOXES; i++) {
+			unsigned int index = handles[i] & COLLIDER_HANDLE_INDEX_MASK;
+			CHECK((int) index < replay->capacity);
+			if ((int) index >= replay->capacity) continue;
+			ColliderHandle replayed = replay->colliders[index].handle;
+			Collider* want = PeekWorldCollider(world, handles[i]);
+			Collider* got = PeekWorldCollider(replayWorld, replayed);
+			CHECK(got != NULL);
+			if (!got) continue;
+			for (int v = 0; v < COLLIDER_VERTEX_COUNT; v++) {
+				CHECK(Vector3Distance(got->vertGlobal[v], want->vertGlobal[v]) < precision);
+			}
+			ColliderFilter a = GetWorldColliderFilter(world, handles[i]);
+			ColliderFilter b = GetWorldColliderFilter(replayWorld, replayed);
+			CHECK(a.category == b.category && a.mask == b.mask && a.group == b.group);
+		}
+	}
+	CHECK(replay && !ReplayColliderTick(replay, replayWorld));
+	CHECK(contacts > 0);
+
+	CloseColliderReplay(replay);
+	FreeColliderWorld(replayWorld);
+	FreeColliderWorld(world);
+	remove(path);
+}
+
+#define CHURN_BOXES 512
+
+// Boxes packed tightly enough to touch, every fifth one a trigger
+static ColliderWorld* CreateChurnWorld(ThreadPool* pool, ColliderHandle* handles) {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	world->pool = pool;
+	world->checksumEnabled = true;
+	world->reorderInterval = 7;
+	for (int i = 0; i < CHURN_BOXES; i++) {
+		handles[i] = AddBox(world, (Vector3) { (i % 32) * 0.9f, 0.f, (i / 32) * 0.9f });
+		SetWorldColliderTrigger(world, handles[i], i % 5 == 0);
+	}
+	return world;
+}
+
+// Moves every box, and every few steps replaces one so handles are reused
+static void ChurnWorld(ColliderWorld* world, ColliderHandle* handles, int step) {
+	Vector3 positions[CHURN_BOXES];
+	for (int i = 0; i < CHURN_BOXES; i++) {
+		positions[i] = (Vector3) {
+			(i % 32) * 0.9f + sinf(step * 0.3f + i) * 0.4f, 0.f,
+			(i / 32) * 0.9f + cosf(step * 0.2f + i * 0.5f) * 0.4f,
+		};
+	}
+	SetWorldTransformBatch(world, (ColliderTransformBatch) { .handles = handles, .positions = positions, .count = CHURN_BOXES });
+	if (step % 4 == 3) {
+		int i = (step * 37) % CHURN_BOXES;
+		RemoveWorldCollider(world, handles[i]);
+		handles[i] = AddBox(world, positions[i]);
+		SetWorldColliderTrigger(world, handles[i], step % 8 == 3);
+	}
+}
+
+// Stepping on a pool gives the same checksum as stepping on one thread
+static void TestChecksumThreadCount(ThreadPool* pool) {
+	ColliderHandle serialHandles[CHURN_BOXES];
+	ColliderHandle parallelHandles[CHURN_BOXES];
+	ColliderWorld* serial = CreateChurnWorld(NULL, serialHandles);
+	ColliderWorld* parallel = CreateChurnWorld(pool, parallelHandles);
+	int contacts = 0;
+	int events = 0;
+	for (int step = 0; step < 40; step++) {
+		ChurnWorld(serial, serialHandles, step);
+		ChurnWorld(parallel, parallelHandles, step);
+		StepColliderWorld(serial);
+		StepColliderWorld(parallel);
+		CHECK(serial->stats.checksum == parallel->stats.checksum);
+		CHECK(serial->triggerEventCount == parallel->triggerEventCount);
+		contacts += serial->contactCount;
+		events += serial->triggerEventCount;
+	}
+	CHECK(contacts > 0);
+	CHECK(events > 0);
+	FreeColliderWorld(serial);
+	FreeColliderWorld(parallel);
+}
+
+// Worlds stepped as a group end up where they do when stepped one by one
+static void TestWorldGroup(ThreadPool* pool) {
+	enum { WORLDS = 5 };
+	ColliderHandle serialHandles[WORLDS][CHURN_BOXES];
+	ColliderHandle groupHandles[WORLDS][CHURN_BOXES];
+	ColliderWorld* serial[WORLDS];
+	ColliderWorld* grouped[WORLDS];
+	ColliderWorldGroup group = CreateColliderWorldGroup(pool);
+	for (int w = 0; w < WORLDS; w++) {
+		serial[w] = CreateChurnWorld(NULL, serialHandles[w]);
+		grouped[w] = CreateChurnWorld(NULL, groupHandles[w]);
+		AddGroupWorld(&group, grouped[w]);
+	}
+
+	// Offsets keep the worlds apart, so a mixup between them shows
+	for (int step = 0; step < 20; step++) {
+		for (int w = 0; w < WORLDS; w++) {
+			ChurnWorld(serial[w], serialHandles[w], step + w * 11);
+			ChurnWorld(grouped[w], groupHandles[w], step + w * 11);
+			StepColliderWorld(serial[w]);
+		}
+		StepColliderWorldGroup(&group);
+		for (int w = 0; w < WORLDS; w++) {
+			CHECK(serial[w]->stats.checksum == grouped[w]->stats.checksum);
+		}
+	}
+
+	FreeColliderWorldGroup(&group);
+	for (int w = 0; w < WORLDS; w++) {
+		FreeColliderWorld(serial[w]);
+		FreeColliderWorld(grouped[w]);
+	}
+}
+
+// A handle removed before the batch runs gets the sentinel, not a crash
+static void TestDistanceBatchStaleHandle(ThreadPool* pool) {
+	ColliderWorld* world = CreateColliderWorld(1.f);
+	ColliderHandle a = AddBox(world, (Vector3) { 0.f, 0.f, 0.f });
+	ColliderHandle b = AddBox(world, (Vector3) { 3.f, 0.f, 0.f });
+	ColliderHandle c = AddBox(world, (Vector3) { 0.f, 5.f, 0.f });
+	RemoveWorldCollider(world, c);
+
+	ColliderHandle first[3] = { a, c, a };
+	ColliderHandle second[3] = { b, a, c };
+	float distances[3];
+	Vector3 pointsA[3], pointsB[3];
+	GetWorldDistanceBatch(world, pool, first, second, 3, distances, pointsA, pointsB);
+
+	CHECK(fabsf(distances[0] - 2.f) < 1e-4f);
+	for (int i = 1; i < 3; i++) {
+		CHECK(distances[i] == -1.f);
+		CHECK(Vector3Equals(pointsA[i], Vector3Zero()));
+		CHECK(Vector3Equals(pointsB[i], Vector3Zero()));
+	}
+
+	GetWorldDistanceBatch(world, pool, first, second, 3, distances, NULL, NULL);
+	CHECK(distances[1] == -1.f);
+	FreeColliderWorld(world);
+}
+
+// Rewrites one field of a saved scene and checks the load rejects it
+typedef void (*SceneDamageFunc)(SceneHeader* header, char* data);
+
+static void CheckDamagedScene(const char* path, const char* bytes, long size, SceneDamageFunc damage) {
+	char* copy = malloc(size);
+	memcpy(copy, bytes, size);
+	damage((SceneHeader*) copy, copy);
+	FILE* file = fopen(path, "wb");
+	fwrite(copy, 1, size, file);
+	fclose(file);
+	free(copy);
+
+	ColliderScene* scene = LoadColliderScene(path);
+	CHECK(scene == NULL);
+	UnloadColliderScene(scene);
+}
+
+static HashGridEntry* GetSceneEntry(SceneHeader* header, char* data, int id) {
+	return (HashGridEntry*) (data + header->gridEntries.offset) + id;
+}
+
+static int* GetSceneBucket(SceneHeader* header, char* data, int id) {
+	return (int*) (data + header->gridBuckets.offset) + GetSceneEntry(header, data, id)->bucket;
+}
+
+static void DamageBucketHead(SceneHeader* header, char* data) {
+	*GetSceneBucket(header, data, 0) = (int) header->gridEntries.count + 100;
+}
+
+static void DamageEntryNext(SceneHeader* header, char* data) {
+	GetSceneEntry(header, data, 0)->next = 1 << 24;
+}
+
+static void DamageEntryCycle(SceneHeader* header, char* data) {
+	HashGridEntry* e = GetSceneEntry(header, data, 0);
+	e->next = *GetSceneBucket(header, data, 0);
+}
+
+static void DamageEntryLevel(SceneHeader* header, char* data) {
+	GetSceneEntry(header, data, 1)->level = HGRID_MAX_LEVELS + 3;
+}
+
+static void DamageEntryBucket(SceneHeader* header, char* data) {
+	GetSceneEntry(header, data, 1)->bucket = (int) header->gridBuckets.count;
+}
+
+static void DamageLevelHead(SceneHeader* header, char* data) {
+	(void) data;
+	header->levelHead[0] = -7;
+}
+
+static void DamageHandleSlot(SceneHeader* header, char* data) {
+	((int*) (data + header->handleSlots.offset))[2] = 1 << 20;
+}
+
+static void DamageInstanceShape(SceneHeader* header, char* data) {
+	((SceneInstance*) (data + header->instances.offset))[3].shape = 9;
+}
+
+// Out of range indices in a scene file must fail the load, not a later query
+static void TestDamagedScene() {
+	const char* path = "test.scene";
+	SceneShape shape = { { -0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, 0.5f } };
+	SceneLayer layer = { "default", { 1, 0xFFFFFFFF, 0 } };
+	SceneInstance instances[8];
+	for (int i = 0; i < 8; i++) {
+		instances[i] = (SceneInstance) { 0, 0, { i * 0.75f, 0.f, 0.f }, QuaternionIdentity() };
+	}
+	CHECK(SaveColliderScene(path, 1.f, 0.f, &shape, 1, instances, 8, &layer, 1));
+
+	ColliderScene* scene = LoadColliderScene(path);
+	CHECK(scene != NULL);
+	if (!scene) return;
+	ColliderHandle handles[8];
+	BoundingBox box = { { -10.f, -10.f, -10.f }, { 10.f, 10.f, 10.f } };
+	CHECK(QueryWorldBox(&scene->world, box, handles, 8) == 8);
+	for (int i = 0; i < 8; i++) {
+		Collider* col = PeekWorldCollider(&scene->world, (ColliderHandle) i);
+		CHECK(col != NULL && fabsf(col->matTranslate.m12 - i * 0.75f) < 1e-5f);
+	}
+	CHECK(GetWorldCollider(&scene->world, 0) == NULL);
+	UnloadColliderScene(scene);
+
+	FILE* file = fopen(path, "rb");
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char* bytes = malloc(size);
+	CHECK(fread(bytes, 1, size, file) == (size_t) size);
+	fclose(file);
+
+	SceneDamageFunc damages[] = {
+		DamageBucketHead, DamageEntryNext, DamageEntryCycle, DamageEntryLevel,
+		DamageEntryBucket, DamageLevelHead, DamageHandleSlot, DamageInstanceShape,
+	};
+	for (int i = 0; i < (int) (sizeof(damages) / sizeof(damages[0])); i++) {
+		CheckDamagedScene(path, bytes, size, damages[i]);
+	}
+	free(bytes);
+	remove(path);
+}
+
+int main() {
+	ThreadPool* pool = CreateThreadPool(4);
+	TestOctreeQueries();
+	TestBoxQueryRotated();
+	TestTriggerPairOrder();
+	TestSteadyStateMallocs();
+	TestPairCacheEviction();
+	TestFilters();
+	TestUnboundedQueries();
+	TestStaleHandle();
+	TestMovedColliders();
+	TestBatchAttachedRotation();
+	TestSnapshotColliders();
+	TestCommandQueueAllocator();
+	TestMemoryReport(pool);
+	TestRollbackRoundTrip();
+	TestHistoryQueries();
+	TestSceneStreaming();
+	TestRecordReplay();
+	TestChecksumThreadCount(pool);
+	TestWorldGroup(pool);
+	TestDistanceBatchStaleHandle(NULL);
+	TestDistanceBatchStaleHandle(pool);
+	FreeThreadPool(pool);
+	TestDamagedScene();
+
+	if (failures == 0) printf("all checks passed\n");
+	return failures != 0;
+}
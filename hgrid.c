@@ -0,0 +1,330 @@
+// 
+// Hierarchical hash grid broadphase
+//
+// 2023, Jonathan Tainer
+//
+
+#include "hgrid.h"
+#include <raymath.h>
+#include <string.h>
+#include <limits.h>
+
+//*******************************************************************
+// Helpers for mapping boxes to levels, cells and buckets
+//*******************************************************************
+
+static float GetLevelCellSize(HashGrid* grid, int level) {
+	return ldexpf(grid->cellSize, level);
+}
+
+// Lowest level whose cells can contain the whole box
+static int GetBoxLevel(HashGrid* grid, BoundingBox box) {
+	Vector3 dim = Vector3Subtract(box.max, box.min);
+	float size = fmaxf(dim.x, fmaxf(dim.y, dim.z));
+	int level = 0;
+	float cellSize = grid->cellSize;
+	while (size > cellSize && level < HGRID_MAX_LEVELS - 1) {
+		cellSize *= 2.f;
+		level++;
+	}
+	return level;
+}
+
+static int GetBucket(HashGrid* grid, int x, int y, int z, int level) {
+	unsigned int h = (unsigned int) x * 73856093u;
+	h ^= (unsigned int) y * 19349663u;
+	h ^= (unsigned int) z * 83492791u;
+	h ^= (unsigned int) level * 67867979u;
+	return (int) (h & (unsigned int) (grid->bucketCount - 1));
+}
+
+static bool BoxesOverlap(BoundingBox a, BoundingBox b) {
+	return a.min.x <= b.max.x && a.max.x >= b.min.x
+		&& a.min.y <= b.max.y && a.max.y >= b.min.y
+		&& a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+static void LinkEntry(HashGrid* grid, int id) {
+	HashGridEntry* e = &grid->entries[id];
+	e->bucket = GetBucket(grid, e->cell[0], e->cell[1], e->cell[2], e->level);
+	e->prev = -1;
+	e->next = grid->buckets[e->bucket];
+	if (e->next >= 0) grid->entries[e->next].prev = id;
+	grid->buckets[e->bucket] = id;
+
+	e->levelPrev = -1;
+	e->levelNext = grid->levelHead[e->level];
+	if (e->levelNext >= 0) grid->entries[e->levelNext].levelPrev = id;
+	grid->levelHead[e->level] = id;
+
+	grid->objectsAtLevel[e->level]++;
+	grid->occupiedLevels |= 1u << e->level;
+	Vector3 dim = Vector3Subtract(e->box.max, e->box.min);
+	float size = fmaxf(dim.x, fmaxf(dim.y, dim.z));
+	grid->maxSizeAtLevel[e->level] = fmaxf(grid->maxSizeAtLevel[e->level], size);
+}
+
+static void UnlinkEntry(HashGrid* grid, int id) {
+	HashGridEntry* e = &grid->entries[id];
+	if (e->prev >= 0) grid->entries[e->prev].next = e->next;
+	else grid->buckets[e->bucket] = e->next;
+	if (e->next >= 0) grid->entries[e->next].prev = e->prev;
+
+	if (e->levelPrev >= 0) grid->entries[e->levelPrev].levelNext = e->levelNext;
+	else grid->levelHead[e->level] = e->levelNext;
+	if (e->levelNext >= 0) grid->entries[e->levelNext].levelPrev = e->levelPrev;
+
+	if (--grid->objectsAtLevel[e->level] == 0) {
+		grid->occupiedLevels &= ~(1u << e->level);
+		grid->maxSizeAtLevel[e->level] = 0.f;
+	}
+}
+
+// Fills in level and cell of an entry from its box
+static void PlaceEntry(HashGrid* grid, HashGridEntry* e) {
+	e->level = GetBoxLevel(grid, e->box);
+	float cellSize = GetLevelCellSize(grid, e->level);
+	Vector3 center = Vector3Scale(Vector3Add(e->box.min, e->box.max), 0.5f);
+	e->cell[0] = (int) floorf(center.x / cellSize);
+	e->cell[1] = (int) floorf(center.y / cellSize);
+	e->cell[2] = (int) floorf(center.z / cellSize);
+}
+
+//*******************************************************************
+// Object management
+//*******************************************************************
+
+HashGrid CreateHashGrid(float cellSize, int bucketCount) {
+	return CreateHashGridEx(cellSize, bucketCount, (ColliderAllocator) { 0 });
+}
+
+HashGrid CreateHashGridEx(float cellSize, int bucketCount, ColliderAllocator allocator) {
+	HashGrid grid = { 0 };
+	grid.cellSize = cellSize;
+	grid.allocator = allocator;
+
+	// Round bucket count up to a power of two so hashing is a mask
+	grid.bucketCount = 1;
+	while (grid.bucketCount < bucketCount) grid.bucketCount *= 2;
+	grid.bucketCapacity = grid.bucketCount;
+	grid.buckets = AllocatorMalloc(&grid.allocator, sizeof(int) * grid.bucketCount);
+	grid.mallocCount = 1;
+	for (int i = 0; i < grid.bucketCount; i++) grid.buckets[i] = -1;
+	for (int i = 0; i < HGRID_MAX_LEVELS; i++) grid.levelHead[i] = -1;
+	return grid;
+}
+
+void FreeHashGrid(HashGrid* grid) {
+	AllocatorFree(&grid->allocator, grid->buckets);
+	AllocatorFree(&grid->allocator, grid->entries);
+	*grid = (HashGrid) { 0 };
+}
+
+// Bucket lists are linked by id, so the arrays copy over as they are.
+// Entries past the end of src are marked as not in the grid.
+void CopyHashGrid(HashGrid* dst, const HashGrid* src) {
+	if (dst->bucketCapacity < src->bucketCount) {
+		dst->buckets = AllocatorRealloc(&dst->allocator, dst->buckets, sizeof(int) * src->bucketCount);
+		dst->bucketCapacity = src->bucketCount;
+		dst->mallocCount++;
+	}
+	if (dst->capacity < src->capacity) {
+		dst->entries = AllocatorRealloc(&dst->allocator, dst->entries, sizeof(HashGridEntry) * src->capacity);
+		dst->capacity = src->capacity;
+		dst->mallocCount++;
+	}
+	dst->bucketCount = src->bucketCount;
+	memcpy(dst->buckets, src->buckets, sizeof(int) * src->bucketCount);
+	if (src->capacity > 0) memcpy(dst->entries, src->entries, sizeof(HashGridEntry) * src->capacity);
+	for (int i = src->capacity; i < dst->capacity; i++) dst->entries[i].level = -1;
+
+	dst->cellSize = src->cellSize;
+	memcpy(dst->objectsAtLevel, src->objectsAtLevel, sizeof(src->objectsAtLevel));
+	memcpy(dst->levelHead, src->levelHead, sizeof(src->levelHead));
+	memcpy(dst->maxSizeAtLevel, src->maxSizeAtLevel, sizeof(src->maxSizeAtLevel));
+	dst->occupiedLevels = src->occupiedLevels;
+}
+
+void HashGridInsert(HashGrid* grid, int id, BoundingBox box) {
+	if (id >= grid->capacity) {
+		int capacity = grid->capacity ? grid->capacity : 64;
+		while (capacity <= id) capacity *= 2;
+		grid->entries = AllocatorRealloc(&grid->allocator, grid->entries, sizeof(HashGridEntry) * capacity);
+		for (int i = grid->capacity; i < capacity; i++) grid->entries[i].level = -1;
+		grid->capacity = capacity;
+		grid->mallocCount++;
+	}
+
+	HashGridEntry* e = &grid->entries[id];
+	if (e->level >= 0) UnlinkEntry(grid, id);
+	e->box = box;
+	PlaceEntry(grid, e);
+	LinkEntry(grid, id);
+}
+
+void HashGridRemove(HashGrid* grid, int id) {
+	if (id >= grid->capacity || grid->entries[id].level < 0) return;
+	UnlinkEntry(grid, id);
+	grid->entries[id].level = -1;
+}
+
+void HashGridUpdate(HashGrid* grid, int id, BoundingBox box) {
+	if (id >= grid->capacity || grid->entries[id].level < 0) {
+		HashGridInsert(grid, id, box);
+		return;
+	}
+
+	// Most moving objects stay in the same cell from one frame to the next
+	HashGridEntry* e = &grid->entries[id];
+	HashGridEntry moved = *e;
+	moved.box = box;
+	PlaceEntry(grid, &moved);
+	if (moved.level == e->level && moved.cell[0] == e->cell[0]
+		&& moved.cell[1] == e->cell[1] && moved.cell[2] == e->cell[2]) {
+		e->box = box;
+		Vector3 dim = Vector3Subtract(box.max, box.min);
+		float size = fmaxf(dim.x, fmaxf(dim.y, dim.z));
+		grid->maxSizeAtLevel[e->level] = fmaxf(grid->maxSizeAtLevel[e->level], size);
+		return;
+	}
+
+	UnlinkEntry(grid, id);
+	*e = moved;
+	LinkEntry(grid, id);
+}
+
+void HashGridClear(HashGrid* grid) {
+	for (int i = 0; i < grid->bucketCount; i++) grid->buckets[i] = -1;
+	for (int i = 0; i < grid->capacity; i++) grid->entries[i].level = -1;
+	for (int i = 0; i < HGRID_MAX_LEVELS; i++) {
+		grid->objectsAtLevel[i] = 0;
+		grid->levelHead[i] = -1;
+		grid->maxSizeAtLevel[i] = 0.f;
+	}
+	grid->occupiedLevels = 0;
+}
+
+//*******************************************************************
+// Queries
+//*******************************************************************
+
+// Visit every object on one level overlapping the box
+// Returns false if the callback asked to stop
+static bool QueryLevel(HashGrid* grid, int level, BoundingBox box, HashGridQueryFunc func, void* user) {
+	// An object overlapping the box can have its center at most half
+	// its size outside of the box, so widen the range of cells by that
+	float cellSize = GetLevelCellSize(grid, level);
+	float margin = fmaxf(cellSize, grid->maxSizeAtLevel[level]) * 0.5f;
+	float boxMin[3] = { box.min.x, box.min.y, box.min.z };
+	float boxMax[3] = { box.max.x, box.max.y, box.max.z };
+	float cellMin[3], cellMax[3];
+	bool inRange = true;
+	double cellCount = 1.0;
+	for (int i = 0; i < 3; i++) {
+		cellMin[i] = floorf((boxMin[i] - margin) / cellSize);
+		cellMax[i] = floorf((boxMax[i] + margin) / cellSize);
+
+		// Cells an int cannot hold, infinite or NaN, are never walked
+		inRange = inRange && cellMin[i] >= (float) INT_MIN && cellMax[i] < (float) INT_MAX;
+		cellCount *= (double) cellMax[i] - cellMin[i] + 1.0;
+	}
+
+	// Huge query on a fine level, or any query on a sparse coarse one,
+	// cheaper to check the level's objects directly
+	if (!inRange || cellCount > grid->objectsAtLevel[level]) {
+		for (int id = grid->levelHead[level]; id >= 0;) {
+			HashGridEntry* e = &grid->entries[id];
+			int next = e->levelNext;
+			if (BoxesOverlap(e->box, box) && !func(id, user)) return false;
+			id = next;
+		}
+		return true;
+	}
+
+	int lo[3], hi[3];
+	for (int i = 0; i < 3; i++) {
+		lo[i] = (int) cellMin[i];
+		hi[i] = (int) cellMax[i];
+	}
+	for (int x = lo[0]; x <= hi[0]; x++) {
+		for (int y = lo[1]; y <= hi[1]; y++) {
+			for (int z = lo[2]; z <= hi[2]; z++) {
+				int id = grid->buckets[GetBucket(grid, x, y, z, level)];
+				while (id >= 0) {
+					HashGridEntry* e = &grid->entries[id];
+					int next = e->next;
+
+					// Buckets are shared, so skip objects from other cells
+					if (e->level == level && e->cell[0] == x && e->cell[1] == y && e->cell[2] == z
+						&& BoxesOverlap(e->box, box)) {
+						if (!func(id, user)) return false;
+					}
+					id = next;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void HashGridQueryEach(HashGrid* grid, BoundingBox box, HashGridQueryFunc func, void* user) {
+	// Walk levels from coarsest to finest
+	for (int level = HGRID_MAX_LEVELS - 1; level >= 0; level--) {
+		if (!(grid->occupiedLevels & (1u << level))) continue;
+		if (!QueryLevel(grid, level, box, func, user)) return;
+	}
+}
+
+typedef struct QueryBuffer {
+	int* ids;
+	int maxCount;
+	int count;
+} QueryBuffer;
+
+static bool AppendQueryResult(int id, void* user) {
+	QueryBuffer* buf = user;
+	if (buf->count < buf->maxCount) buf->ids[buf->count] = id;
+	buf->count++;
+	return true;
+}
+
+int HashGridQuery(HashGrid* grid, BoundingBox box, int* ids, int maxCount) {
+	QueryBuffer buf = { ids, maxCount, 0 };
+	HashGridQueryEach(grid, box, AppendQueryResult, &buf);
+	return buf.count;
+}
+
+typedef struct PairContext {
+	HashGrid* grid;
+	HashGridPairFunc func;
+	void* user;
+	int id;
+	int level;
+} PairContext;
+
+static bool ReportPair(int other, void* user) {
+	PairContext* ctx = user;
+
+	// Objects on the same level would otherwise find each other twice
+	if (other == ctx->id) return true;
+	if (ctx->grid->entries[other].level == ctx->level && other < ctx->id) return true;
+	ctx->func(ctx->id, other, ctx->user);
+	return true;
+}
+
+void HashGridFindPairs(HashGrid* grid, HashGridPairFunc func, void* user) {
+	PairContext ctx = { grid, func, user, 0, 0 };
+
+	// Each object only looks at its own level and coarser ones, so
+	// every pair is found by the object on the finer level
+	for (int id = 0; id < grid->capacity; id++) {
+		HashGridEntry* e = &grid->entries[id];
+		if (e->level < 0) continue;
+		ctx.id = id;
+		ctx.level = e->level;
+		for (int level = HGRID_MAX_LEVELS - 1; level >= e->level; level--) {
+			if (!(grid->occupiedLevels & (1u << level))) continue;
+			QueryLevel(grid, level, e->box, ReportPair, &ctx);
+		}
+	}
+}
@@ -0,0 +1,110 @@
+// 
+// Hierarchical hash grid broadphase
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef HGRID_H
+#define HGRID_H
+
+#include <raylib.h>
+#include "allocator.h"
+
+#define HGRID_MAX_LEVELS 16
+
+// Bookkeeping for one object, indexed by the id given on insertion
+typedef struct HashGridEntry {
+	// Bounds of the object in global space
+	BoundingBox box;
+
+	// Cell containing the center of the box at the object's level
+	int cell[3];
+
+	// Level the object lives on, -1 if the id is not in the grid
+	int level;
+
+	// Intrusive doubly linked list through the bucket
+	int bucket;
+	int next;
+	int prev;
+
+	// Intrusive doubly linked list through every object on the level
+	int levelNext;
+	int levelPrev;
+} HashGridEntry;
+
+// Each level has cells twice the size of the level below it. Objects
+// are placed in the single cell containing their center, on the lowest
+// level whose cells are at least as large as the object, so an object
+// never occupies more than one cell no matter how large it is.
+typedef struct HashGrid {
+	// Cell size of the finest level
+	float cellSize;
+
+	// Buckets shared by all levels, count is a power of two
+	int* buckets;
+	int bucketCount;
+
+	// Buckets allocated, more than the count after copying a smaller grid
+	int bucketCapacity;
+
+	HashGridEntry* entries;
+	int capacity;
+
+	// Used to skip empty levels entirely
+	int objectsAtLevel[HGRID_MAX_LEVELS];
+
+	// First object on each level, so queries too large for the cells
+	// can check the level's objects directly
+	int levelHead[HGRID_MAX_LEVELS];
+	unsigned int occupiedLevels;
+
+	// Largest object on each level, only the top level can exceed the cell size
+	float maxSizeAtLevel[HGRID_MAX_LEVELS];
+
+	// Number of heap allocations ever made by the grid
+	int mallocCount;
+
+	ColliderAllocator allocator;
+} HashGrid;
+
+// Called once for every pair of overlapping boxes
+typedef void (*HashGridPairFunc)(int a, int b, void* user);
+
+// Called for every box overlapping a query, return false to stop early
+typedef bool (*HashGridQueryFunc)(int id, void* user);
+
+// Cell size should be about the size of the smallest objects
+HashGrid CreateHashGrid(float cellSize, int bucketCount);
+
+// Same as above, with all memory coming from the given allocator
+HashGrid CreateHashGridEx(float cellSize, int bucketCount, ColliderAllocator allocator);
+
+void FreeHashGrid(HashGrid* grid);
+
+// Make dst an exact copy of src. Memory only grows, so copying back and
+// forth between grids of different sizes stops allocating once dst has
+// seen the largest.
+void CopyHashGrid(HashGrid* dst, const HashGrid* src);
+
+// Ids are small non-negative integers chosen by the caller
+void HashGridInsert(HashGrid* grid, int id, BoundingBox box);
+
+void HashGridRemove(HashGrid* grid, int id);
+
+// Relinks the object only if it changed cell or level
+void HashGridUpdate(HashGrid* grid, int id, BoundingBox box);
+
+// Remove every object, keeps allocated memory
+void HashGridClear(HashGrid* grid);
+
+// Writes up to maxCount ids overlapping the box, returns total number found
+int HashGridQuery(HashGrid* grid, BoundingBox box, int* ids, int maxCount);
+
+// Same as above, but stops as soon as the callback returns false
+void HashGridQueryEach(HashGrid* grid, BoundingBox box, HashGridQueryFunc func, void* user);
+
+// Report every pair of objects with overlapping boxes exactly once
+void HashGridFindPairs(HashGrid* grid, HashGridPairFunc func, void* user);
+
+#endif
@@ -0,0 +1,178 @@
+// 
+// Ring of past collider poses for lag compensated queries
+//
+// 2023, Jonathan Tainer
+//
+
+#include "history.h"
+#include <raymath.h>
+
+static void ReserveFrame(ColliderHistory* history, HistoryFrame* frame, int needed) {
+	if (needed <= frame->capacity) return;
+	int capacity = frame->capacity ? frame->capacity : 64;
+	while (capacity < needed) capacity *= 2;
+	frame->handles = AllocatorRealloc(&history->allocator, frame->handles, sizeof(ColliderHandle) * capacity);
+	frame->poses = AllocatorRealloc(&history->allocator, frame->poses, sizeof(ColliderPose) * capacity);
+	frame->capacity = capacity;
+}
+
+static HistoryFrame* FindFrame(ColliderHistory* history, int tick) {
+	int slot = tick % history->frameCount;
+	if (slot < 0) slot += history->frameCount;
+	HistoryFrame* frame = &history->frames[slot];
+	return frame->tick == tick ? frame : NULL;
+}
+
+static ColliderPose* FindPose(HistoryFrame* frame, ColliderHandle handle) {
+	unsigned int index = handle & COLLIDER_HANDLE_INDEX_MASK;
+	if (index >= (unsigned int) frame->count || frame->handles[index] != handle) return NULL;
+	return &frame->poses[index];
+}
+
+ColliderHistory CreateColliderHistory(ColliderWorld* world, int tickCount) {
+	ColliderHistory history = { 0 };
+	history.allocator = world->allocator;
+	history.frameCount = tickCount < 1 ? 1 : tickCount;
+	history.frames = AllocatorMalloc(&history.allocator, sizeof(HistoryFrame) * history.frameCount);
+	for (int i = 0; i < history.frameCount; i++) {
+		history.frames[i] = (HistoryFrame) { -1, NULL, NULL, 0, 0 };
+		ReserveFrame(&history, &history.frames[i], world->handleCount);
+	}
+	return history;
+}
+
+void FreeColliderHistory(ColliderHistory* history) {
+	for (int i = 0; i < history->frameCount; i++) {
+		AllocatorFree(&history->allocator, history->frames[i].handles);
+		AllocatorFree(&history->allocator, history->frames[i].poses);
+	}
+	AllocatorFree(&history->allocator, history->frames);
+	*history = (ColliderHistory) { 0 };
+}
+
+void RecordColliderHistory(ColliderHistory* history, ColliderWorld* world, int tick) {
+	int slot = tick % history->frameCount;
+	if (slot < 0) slot += history->frameCount;
+	HistoryFrame* frame = &history->frames[slot];
+	ReserveFrame(history, frame, world->handleCount);
+	frame->tick = tick;
+	frame->count = world->handleCount;
+	for (int i = 0; i < frame->count; i++) frame->handles[i] = COLLIDER_HANDLE_INVALID;
+
+	for (int i = 0; i < world->count; i++) {
+		Collider* col = &world->colliders[i];
+		unsigned int index = world->slotHandle[i] & COLLIDER_HANDLE_INDEX_MASK;
+		frame->handles[index] = world->slotHandle[i];
+		frame->poses[index] = (ColliderPose) {
+			{ col->matTranslate.m12, col->matTranslate.m13, col->matTranslate.m14 },
+			QuaternionFromMatrix(col->matRotate),
+		};
+	}
+}
+
+void ShiftColliderHistory(ColliderHistory* history, Vector3 shift) {
+	for (int i = 0; i < history->frameCount; i++) {
+		HistoryFrame* frame = &history->frames[i];
+		for (int j = 0; j < frame->count; j++) {
+			frame->poses[j].position = Vector3Subtract(frame->poses[j].position, shift);
+		}
+	}
+}
+
+// Pose between the tick's frame and the next, or exactly at the frame
+// if the next one is missing or the collider was not in it
+static bool GetPoseAt(HistoryFrame* frame, HistoryFrame* next, float alpha, ColliderHandle handle, ColliderPose* pose) {
+	ColliderPose* a = FindPose(frame, handle);
+	if (!a) return false;
+	ColliderPose* b = next ? FindPose(next, handle) : NULL;
+	if (!b || alpha <= 0.f) {
+		*pose = *a;
+		return true;
+	}
+	pose->position = Vector3Lerp(a->position, b->position, alpha);
+	pose->rotation = QuaternionSlerp(a->rotation, b->rotation, alpha);
+	return true;
+}
+
+// Copy of the world's collider placed at the pose
+static bool PlaceCollider(ColliderWorld* world, ColliderHandle handle, ColliderPose pose, Collider* col) {
+	Collider* current = PeekWorldCollider(world, handle);
+	if (!current) return false;
+	*col = *current;
+	Matrix transform = QuaternionToMatrix(pose.rotation);
+	transform.m12 = pose.position.x;
+	transform.m13 = pose.position.y;
+	transform.m14 = pose.position.z;
+	SetColliderTransform(col, transform);
+	return true;
+}
+
+bool GetHistoryCollider(ColliderHistory* history, ColliderWorld* world, ColliderHandle handle, float tick, Collider* col) {
+	int base = (int) floorf(tick);
+	HistoryFrame* frame = FindFrame(history, base);
+	if (!frame) return false;
+	ColliderPose pose;
+	if (!GetPoseAt(frame, FindFrame(history, base + 1), tick - base, handle, &pose)) return false;
+	return PlaceCollider(world, handle, pose, col);
+}
+
+static bool BoxesOverlap(BoundingBox a, BoundingBox b) {
+	return a.min.x <= b.max.x && a.max.x >= b.min.x
+		&& a.min.y <= b.max.y && a.max.y >= b.min.y
+		&& a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Past positions are not in the broadphase, so both queries scan every
+// collider recorded at the tick. Servers rewinding a few hundred
+// hitboxes for a shot are well within what that costs.
+int QueryHistoryBox(ColliderHistory* history, ColliderWorld* world, float tick, BoundingBox box,
+	ColliderHandle* handles, int maxCount) {
+	int base = (int) floorf(tick);
+	HistoryFrame* frame = FindFrame(history, base);
+	if (!frame) return -1;
+	HistoryFrame* next = FindFrame(history, base + 1);
+
+	// Bounds of a rewound collider can touch the box while it does not
+	Collider shape = CreateCollider(box.min, box.max);
+	int found = 0;
+	for (int i = 0; i < frame->count; i++) {
+		ColliderHandle handle = frame->handles[i];
+		ColliderPose pose;
+		Collider col;
+		if (handle == COLLIDER_HANDLE_INVALID || !GetPoseAt(frame, next, tick - base, handle, &pose)) continue;
+		if (!PlaceCollider(world, handle, pose, &col)) continue;
+		if (!BoxesOverlap(GetColliderBounds(&col), box) || !TestColliderPair(&shape, &col)) continue;
+		if (found < maxCount) handles[found] = handle;
+		found++;
+	}
+	return found;
+}
+
+bool RaycastHistory(ColliderHistory* history, ColliderWorld* world, float tick, Ray ray, float maxDistance,
+	ColliderHandle* handle, RayCollision* hit) {
+	int base = (int) floorf(tick);
+	HistoryFrame* frame = FindFrame(history, base);
+	if (!frame) return false;
+	HistoryFrame* next = FindFrame(history, base + 1);
+
+	RayCollision best = { 0 };
+	best.distance = maxDistance;
+	ColliderHandle bestHandle = COLLIDER_HANDLE_INVALID;
+	for (int i = 0; i < frame->count; i++) {
+		ColliderHandle candidate = frame->handles[i];
+		ColliderPose pose;
+		Collider col;
+		if (candidate == COLLIDER_HANDLE_INVALID || !GetPoseAt(frame, next, tick - base, candidate, &pose)) continue;
+		if (!PlaceCollider(world, candidate, pose, &col)) continue;
+		RayCollision result = GetColliderRayCollision(&col, ray);
+		if (result.hit && result.distance <= best.distance) {
+			best = result;
+			bestHandle = candidate;
+		}
+	}
+
+	if (bestHandle == COLLIDER_HANDLE_INVALID) return false;
+	if (handle) *handle = bestHandle;
+	if (hit) *hit = best;
+	return true;
+}
@@ -0,0 +1,62 @@
+// 
+// Ring of past collider poses for lag compensated queries
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "world.h"
+
+// Rigid placement of a collider, its shape comes from the world
+typedef struct ColliderPose {
+	Vector3 position;
+	Quaternion rotation;
+} ColliderPose;
+
+// Poses of every collider at one tick, indexed by handle index
+typedef struct HistoryFrame {
+	int tick;
+	ColliderHandle* handles;
+	ColliderPose* poses;
+	int count;
+	int capacity;
+} HistoryFrame;
+
+// Last few ticks of poses. Queries place colliders at a past time by
+// interpolating between the two ticks around it, so the world itself
+// is never rewound or rebuilt.
+typedef struct ColliderHistory {
+	HistoryFrame* frames;
+	int frameCount;
+	ColliderAllocator allocator;
+} ColliderHistory;
+
+// Frames are sized for the world as it is now
+ColliderHistory CreateColliderHistory(ColliderWorld* world, int tickCount);
+
+void FreeColliderHistory(ColliderHistory* history);
+
+// Overwrites whatever was recorded tickCount ticks earlier
+void RecordColliderHistory(ColliderHistory* history, ColliderWorld* world, int tick);
+
+// Call with the same shift as RebaseColliderWorld so recorded poses
+// stay in the world's coordinates
+void ShiftColliderHistory(ColliderHistory* history, Vector3 shift);
+
+// Collider as it was at a fractional tick. Fails if the tick is not in
+// the history or the collider did not exist then or does not now.
+bool GetHistoryCollider(ColliderHistory* history, ColliderWorld* world, ColliderHandle handle, float tick, Collider* col);
+
+// Colliders overlapping the box at a past tick, writes up to maxCount
+// handles and returns the total. -1 if the tick is not in the history.
+int QueryHistoryBox(ColliderHistory* history, ColliderWorld* world, float tick, BoundingBox box,
+	ColliderHandle* handles, int maxCount);
+
+// Nearest collider hit by the ray at a past tick, within maxDistance
+// multiples of the ray direction
+bool RaycastHistory(ColliderHistory* history, ColliderWorld* world, float tick, Ray ray, float maxDistance,
+	ColliderHandle* handle, RayCollision* hit);
+
+#endif
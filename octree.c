@@ -0,0 +1,273 @@
+// 
+// Loose octree for region queries
+//
+// 2023, Jonathan Tainer
+//
+
+#include "octree.h"
+#include <raymath.h>
+
+//*******************************************************************
+// Node indexing. Level l holds (2^l)^3 nodes stored after all the
+// nodes of the levels above it.
+//*******************************************************************
+
+static int GetLevelOffset(int level) {
+	return ((1 << (3 * level)) - 1) / 7;
+}
+
+static int GetNodeIndex(int level, int x, int y, int z) {
+	int n = 1 << level;
+	return GetLevelOffset(level) + x + n * (y + n * z);
+}
+
+// Add to the object count of a node and all of its ancestors
+static void AdjustNodeCounts(Octree* tree, int node, int delta) {
+	int level = 0;
+	while (GetLevelOffset(level + 1) <= node) level++;
+	int n = 1 << level;
+	int local = node - GetLevelOffset(level);
+	int x = local % n;
+	int y = (local / n) % n;
+	int z = local / (n * n);
+	for (; level >= 0; level--) {
+		tree->nodeCount[GetNodeIndex(level, x, y, z)] += delta;
+		x >>= 1;
+		y >>= 1;
+		z >>= 1;
+	}
+}
+
+// Find the node an object belongs in
+static int GetBoxNode(Octree* tree, BoundingBox box) {
+	Vector3 dim = Vector3Subtract(box.max, box.min);
+	float extent = fmaxf(dim.x, fmaxf(dim.y, dim.z));
+
+	// Deepest level whose cells are at least as big as the object,
+	// the loose bounds then contain it as long as its center is inside the cell
+	int level = tree->depth - 1;
+	if (extent > 0.f) {
+		int fit = (int) floorf(log2f(tree->size / extent));
+		if (fit < level) level = fit;
+	}
+	if (level <= 0) return 0;
+
+	Vector3 center = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
+	Vector3 rel = Vector3Scale(Vector3Subtract(center, tree->origin), 1.f / tree->size);
+	if (rel.x < 0.f || rel.y < 0.f || rel.z < 0.f || rel.x >= 1.f || rel.y >= 1.f || rel.z >= 1.f) return 0;
+
+	int n = 1 << level;
+	return GetNodeIndex(level, (int) (rel.x * n), (int) (rel.y * n), (int) (rel.z * n));
+}
+
+static void LinkEntry(Octree* tree, int id, int node) {
+	OctreeEntry* e = &tree->entries[id];
+	e->node = node;
+	e->prev = -1;
+	e->next = tree->nodeHead[node];
+	if (e->next >= 0) tree->entries[e->next].prev = id;
+	tree->nodeHead[node] = id;
+	AdjustNodeCounts(tree, node, 1);
+}
+
+static void UnlinkEntry(Octree* tree, int id) {
+	OctreeEntry* e = &tree->entries[id];
+	if (e->prev >= 0) tree->entries[e->prev].next = e->next;
+	else tree->nodeHead[e->node] = e->next;
+	if (e->next >= 0) tree->entries[e->next].prev = e->prev;
+	AdjustNodeCounts(tree, e->node, -1);
+	e->node = -1;
+}
+
+//*******************************************************************
+// Object management
+//*******************************************************************
+
+Octree CreateOctree(Vector3 origin, float size, int depth) {
+	return CreateOctreeEx(origin, size, depth, (ColliderAllocator) { 0 });
+}
+
+Octree CreateOctreeEx(Vector3 origin, float size, int depth, ColliderAllocator allocator) {
+	Octree tree = { 0 };
+	tree.allocator = allocator;
+	tree.origin = origin;
+	tree.size = size;
+	tree.depth = (int) Clamp(depth, 1, OCTREE_MAX_DEPTH);
+	tree.nodeTotal = GetLevelOffset(tree.depth);
+	tree.nodeHead = AllocatorMalloc(&tree.allocator, sizeof(int) * tree.nodeTotal);
+	tree.nodeCount = AllocatorMalloc(&tree.allocator, sizeof(int) * tree.nodeTotal);
+	for (int i = 0; i < tree.nodeTotal; i++) {
+		tree.nodeHead[i] = -1;
+		tree.nodeCount[i] = 0;
+	}
+	return tree;
+}
+
+void FreeOctree(Octree* tree) {
+	AllocatorFree(&tree->allocator, tree->nodeHead);
+	AllocatorFree(&tree->allocator, tree->nodeCount);
+	AllocatorFree(&tree->allocator, tree->entries);
+	*tree = (Octree) { 0 };
+}
+
+void OctreeInsert(Octree* tree, int id, BoundingBox box) {
+	if (id >= tree->capacity) {
+		int capacity = tree->capacity ? tree->capacity : 64;
+		while (capacity <= id) capacity *= 2;
+		tree->entries = AllocatorRealloc(&tree->allocator, tree->entries, sizeof(OctreeEntry) * capacity);
+		for (int i = tree->capacity; i < capacity; i++) tree->entries[i].node = -1;
+		tree->capacity = capacity;
+	}
+
+	if (tree->entries[id].node >= 0) UnlinkEntry(tree, id);
+	tree->entries[id].box = box;
+	LinkEntry(tree, id, GetBoxNode(tree, box));
+}
+
+void OctreeRemove(Octree* tree, int id) {
+	if (id >= tree->capacity || tree->entries[id].node < 0) return;
+	UnlinkEntry(tree, id);
+}
+
+void OctreeUpdate(Octree* tree, int id, BoundingBox box) {
+	if (id >= tree->capacity || tree->entries[id].node < 0) {
+		OctreeInsert(tree, id, box);
+		return;
+	}
+
+	OctreeEntry* e = &tree->entries[id];
+	int node = GetBoxNode(tree, box);
+	e->box = box;
+	if (node == e->node) return;
+	UnlinkEntry(tree, id);
+	LinkEntry(tree, id, node);
+}
+
+//*******************************************************************
+// Region queries
+//*******************************************************************
+
+typedef enum RegionType {
+	REGION_BOX,
+	REGION_SPHERE,
+	REGION_FRUSTUM,
+} RegionType;
+
+typedef struct Region {
+	RegionType type;
+	BoundingBox box;
+	Vector3 center;
+	float radius;
+	Frustum frustum;
+} Region;
+
+typedef struct QueryBuffer {
+	int* ids;
+	int maxCount;
+	int count;
+} QueryBuffer;
+
+// Conservative test, may report boxes just outside of a frustum corner
+static bool RegionOverlapsBox(const Region* region, BoundingBox box) {
+	switch (region->type) {
+	case REGION_BOX:
+		return box.min.x <= region->box.max.x && box.max.x >= region->box.min.x
+			&& box.min.y <= region->box.max.y && box.max.y >= region->box.min.y
+			&& box.min.z <= region->box.max.z && box.max.z >= region->box.min.z;
+	case REGION_SPHERE: {
+		Vector3 closest = Vector3Min(Vector3Max(region->center, box.min), box.max);
+		Vector3 diff = Vector3Subtract(closest, region->center);
+		return Vector3DotProduct(diff, diff) <= region->radius * region->radius;
+	}
+	case REGION_FRUSTUM:
+		// Box is outside if its most positive corner is behind any plane
+		for (int i = 0; i < 6; i++) {
+			Vector4 p = region->frustum.planes[i];
+			Vector3 corner = {
+				p.x >= 0.f ? box.max.x : box.min.x,
+				p.y >= 0.f ? box.max.y : box.min.y,
+				p.z >= 0.f ? box.max.z : box.min.z,
+			};
+			if (p.x * corner.x + p.y * corner.y + p.z * corner.z + p.w < 0.f) return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+static void QueryNode(Octree* tree, int level, int x, int y, int z, const Region* region, QueryBuffer* buf) {
+	int node = GetNodeIndex(level, x, y, z);
+	if (tree->nodeCount[node] == 0) return;
+
+	// Root also holds everything outside the tree, so it is never culled
+	if (level > 0) {
+		float cellSize = tree->size / (1 << level);
+		Vector3 cellMin = Vector3Add(tree->origin, Vector3Scale((Vector3) { x, y, z }, cellSize));
+		Vector3 half = { cellSize * 0.5f, cellSize * 0.5f, cellSize * 0.5f };
+		BoundingBox loose = {
+			Vector3Subtract(cellMin, half),
+			Vector3Add(cellMin, Vector3Scale(half, 3.f)),
+		};
+		if (!RegionOverlapsBox(region, loose)) return;
+	}
+
+	for (int id = tree->nodeHead[node]; id >= 0; id = tree->entries[id].next) {
+		if (!RegionOverlapsBox(region, tree->entries[id].box)) continue;
+		if (buf->count < buf->maxCount) buf->ids[buf->count] = id;
+		buf->count++;
+	}
+
+	if (level + 1 >= tree->depth) return;
+	for (int i = 0; i < 8; i++) {
+		QueryNode(tree, level + 1, 2*x + (i & 1), 2*y + ((i >> 1) & 1), 2*z + (i >> 2), region, buf);
+	}
+}
+
+static int QueryRegion(Octree* tree, const Region* region, int* ids, int maxCount) {
+	QueryBuffer buf = { ids, maxCount, 0 };
+	if (tree->nodeTotal > 0) QueryNode(tree, 0, 0, 0, 0, region, &buf);
+	return buf.count;
+}
+
+int OctreeQueryBox(Octree* tree, BoundingBox box, int* ids, int maxCount) {
+	Region region = { .type = REGION_BOX, .box = box };
+	return QueryRegion(tree, &region, ids, maxCount);
+}
+
+int OctreeQuerySphere(Octree* tree, Vector3 center, float radius, int* ids, int maxCount) {
+	Region region = { .type = REGION_SPHERE, .center = center, .radius = radius };
+	return QueryRegion(tree, &region, ids, maxCount);
+}
+
+int OctreeQueryFrustum(Octree* tree, Frustum frustum, int* ids, int maxCount) {
+	Region region = { .type = REGION_FRUSTUM, .frustum = frustum };
+	return QueryRegion(tree, &region, ids, maxCount);
+}
+
+// Gribb-Hartmann plane extraction, rows of the matrix combined
+// to get left, right, bottom, top, near and far planes
+Frustum GetMatrixFrustum(Matrix m) {
+	Vector4 row[4] = {
+		{ m.m0, m.m4, m.m8, m.m12 },
+		{ m.m1, m.m5, m.m9, m.m13 },
+		{ m.m2, m.m6, m.m10, m.m14 },
+		{ m.m3, m.m7, m.m11, m.m15 },
+	};
+
+	Frustum f = { 0 };
+	for (int i = 0; i < 3; i++) {
+		for (int s = 0; s < 2; s++) {
+			float sign = s ? -1.f : 1.f;
+			Vector4 p = {
+				row[3].x + sign * row[i].x,
+				row[3].y + sign * row[i].y,
+				row[3].z + sign * row[i].z,
+				row[3].w + sign * row[i].w,
+			};
+			float len = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+			if (len > 0.f) p = (Vector4) { p.x / len, p.y / len, p.z / len, p.w / len };
+			f.planes[2*i + s] = p;
+		}
+	}
+	return f;
+}
@@ -0,0 +1,80 @@
+// 
+// Loose octree for region queries
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <raylib.h>
+#include "allocator.h"
+
+// Every level is allocated up front, 7 levels is about 300k nodes
+#define OCTREE_MAX_DEPTH 7
+
+// Planes stored as (a, b, c, d), points with ax + by + cz + d >= 0 are inside
+typedef struct Frustum {
+	Vector4 planes[6];
+} Frustum;
+
+// Bookkeeping for one object, indexed by the id given on insertion
+typedef struct OctreeEntry {
+	BoundingBox box;
+
+	// Node holding the object, -1 if the id is not in the tree
+	int node;
+
+	// Intrusive doubly linked list through the node
+	int next;
+	int prev;
+} OctreeEntry;
+
+// The tree is a complete octree stored level by level. Each node's
+// bounds are loosened to twice the size of its cell, so an object can
+// be placed in O(1) from its size (which picks the level) and its
+// center (which picks the cell), and never straddles a boundary.
+typedef struct Octree {
+	// Min corner and edge length of the root cell
+	Vector3 origin;
+	float size;
+	int depth;
+
+	// First object in each node, and number of objects in the node and its children
+	int* nodeHead;
+	int* nodeCount;
+	int nodeTotal;
+
+	OctreeEntry* entries;
+	int capacity;
+
+	ColliderAllocator allocator;
+} Octree;
+
+// Objects centered outside of the root cell are kept in the root
+Octree CreateOctree(Vector3 origin, float size, int depth);
+
+// Same as above, with all memory coming from the given allocator
+Octree CreateOctreeEx(Vector3 origin, float size, int depth, ColliderAllocator allocator);
+
+void FreeOctree(Octree* tree);
+
+// Ids are small non-negative integers chosen by the caller
+void OctreeInsert(Octree* tree, int id, BoundingBox box);
+
+void OctreeRemove(Octree* tree, int id);
+
+// Moves the object to a new node only if its level or cell changed
+void OctreeUpdate(Octree* tree, int id, BoundingBox box);
+
+// Region queries write up to maxCount ids and return the total number found
+int OctreeQueryBox(Octree* tree, BoundingBox box, int* ids, int maxCount);
+
+int OctreeQuerySphere(Octree* tree, Vector3 center, float radius, int* ids, int maxCount);
+
+int OctreeQueryFrustum(Octree* tree, Frustum frustum, int* ids, int maxCount);
+
+// Extract the six clip planes of a combined view and projection matrix
+Frustum GetMatrixFrustum(Matrix viewProj);
+
+#endif
@@ -0,0 +1,186 @@
+// 
+// Persistent per-pair state keyed by collider handles
+//
+// 2023, Jonathan Tainer
+//
+
+#include "paircache.h"
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned long long GetPairKey(unsigned int a, unsigned int b) {
+	if (a > b) {
+		unsigned int temp = a;
+		a = b;
+		b = temp;
+	}
+	return ((unsigned long long) a << 32) | b;
+}
+
+// Finalizer from splitmix64, consecutive handles spread across the table
+static int GetPairSlot(unsigned long long key, int capacity) {
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ull;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebull;
+	key ^= key >> 31;
+	return (int) (key & (unsigned long long) (capacity - 1));
+}
+
+static PairCacheEntry* AllocTable(PairCache* cache, int capacity) {
+	cache->mallocCount++;
+	PairCacheEntry* table = AllocatorMalloc(&cache->allocator, sizeof(PairCacheEntry) * capacity);
+	for (int i = 0; i < capacity; i++) table[i].key = PAIR_CACHE_EMPTY;
+	return table;
+}
+
+// Caller makes sure the table never fills up
+static void InsertEntry(PairCacheEntry* table, int capacity, PairCacheEntry entry) {
+	int slot = GetPairSlot(entry.key, capacity);
+	while (table[slot].key != PAIR_CACHE_EMPTY) slot = (slot + 1) & (capacity - 1);
+	table[slot] = entry;
+}
+
+static int CompareEntryKeys(const void* a, const void* b) {
+	unsigned long long ka = ((const PairCacheEntry*) a)->key;
+	unsigned long long kb = ((const PairCacheEntry*) b)->key;
+	return ka < kb ? -1 : ka > kb;
+}
+
+PairCache CreatePairCache(int capacity) {
+	return CreatePairCacheEx(capacity, (ColliderAllocator) { 0 });
+}
+
+PairCache CreatePairCacheEx(int capacity, ColliderAllocator allocator) {
+	PairCache cache = { 0 };
+	cache.allocator = allocator;
+	cache.capacity = 64;
+	while (cache.capacity < capacity) cache.capacity *= 2;
+	cache.tableCapacity = cache.capacity;
+	cache.entries = AllocTable(&cache, cache.capacity);
+	cache.spare = AllocTable(&cache, cache.capacity);
+	return cache;
+}
+
+void FreePairCache(PairCache* cache) {
+	AllocatorFree(&cache->allocator, cache->buffers);
+	AllocatorFree(&cache->allocator, cache->entries);
+	AllocatorFree(&cache->allocator, cache->spare);
+	*cache = (PairCache) { 0 };
+}
+
+// The spare table is cleared at the end of every step, so only the
+// live table needs its contents copied
+void CopyPairCache(PairCache* dst, const PairCache* src) {
+	if (dst->tableCapacity < src->capacity) {
+		dst->entries = AllocatorRealloc(&dst->allocator, dst->entries, sizeof(PairCacheEntry) * src->capacity);
+		dst->spare = AllocatorRealloc(&dst->allocator, dst->spare, sizeof(PairCacheEntry) * src->capacity);
+		dst->tableCapacity = src->capacity;
+		dst->mallocCount += 2;
+	}
+	dst->capacity = src->capacity;
+	memcpy(dst->entries, src->entries, sizeof(PairCacheEntry) * src->capacity);
+	dst->count = src->count;
+	dst->generation = src->generation;
+}
+
+void BeginPairCacheStep(PairCache* cache, Arena* arenas, int threadCount) {
+	if (threadCount > cache->bufferCount) {
+		cache->buffers = AllocatorRealloc(&cache->allocator, cache->buffers, sizeof(PairCacheBuffer) * threadCount);
+		cache->mallocCount++;
+	}
+	cache->bufferCount = threadCount;
+	for (int i = 0; i < threadCount; i++) cache->buffers[i] = (PairCacheBuffer) { &arenas[i], NULL, 0, 0 };
+	cache->generation++;
+}
+
+PairCacheEntry* PairCacheFind(PairCache* cache, unsigned int a, unsigned int b) {
+	unsigned long long key = GetPairKey(a, b);
+	int slot = GetPairSlot(key, cache->capacity);
+	while (cache->entries[slot].key != PAIR_CACHE_EMPTY) {
+		if (cache->entries[slot].key == key) return &cache->entries[slot];
+		slot = (slot + 1) & (cache->capacity - 1);
+	}
+	return NULL;
+}
+
+PairCacheEntry* PairCacheTouch(PairCache* cache, int thread, unsigned int a, unsigned int b) {
+	PairCacheEntry* entry = PairCacheFind(cache, a, b);
+	if (!entry) {
+		PairCacheBuffer* buf = &cache->buffers[thread];
+		if (buf->count == buf->capacity) {
+			int capacity = buf->capacity ? buf->capacity * 2 : 64;
+			buf->entries = ArenaRealloc(buf->arena, buf->entries,
+				sizeof(PairCacheEntry) * buf->capacity, sizeof(PairCacheEntry) * capacity);
+			buf->capacity = capacity;
+		}
+		entry = &buf->entries[buf->count++];
+		*entry = (PairCacheEntry) { 0 };
+		entry->key = GetPairKey(a, b);
+		entry->firstGeneration = cache->generation;
+	}
+	entry->generation = cache->generation;
+	return entry;
+}
+
+void EndPairCacheStep(PairCache* cache) {
+	int live = 0;
+	for (int i = 0; i < cache->capacity; i++) {
+		if (cache->entries[i].key != PAIR_CACHE_EMPTY && cache->entries[i].generation == cache->generation) live++;
+	}
+	for (int i = 0; i < cache->bufferCount; i++) live += cache->buffers[i].count;
+
+	// Keep the load factor under one half so probe chains stay short
+	if (live * 2 > cache->capacity) {
+		int capacity = cache->capacity;
+		while (live * 2 > capacity) capacity *= 2;
+		PairCacheEntry* old = cache->entries;
+		int oldCapacity = cache->capacity;
+		if (capacity > cache->tableCapacity) {
+			AllocatorFree(&cache->allocator, cache->spare);
+			cache->spare = AllocTable(cache, capacity);
+			cache->entries = AllocTable(cache, capacity);
+			cache->tableCapacity = capacity;
+		}
+		else {
+			// Tables kept from copying a larger cache already fit
+			cache->entries = cache->spare;
+			cache->spare = old;
+			for (int i = 0; i < capacity; i++) cache->entries[i].key = PAIR_CACHE_EMPTY;
+		}
+		cache->capacity = capacity;
+		for (int i = 0; i < oldCapacity; i++) {
+			if (old[i].key != PAIR_CACHE_EMPTY) InsertEntry(cache->entries, capacity, old[i]);
+		}
+		if (old != cache->spare) AllocatorFree(&cache->allocator, old);
+	}
+
+	// Rehash the survivors and the new pairs into the spare table
+	for (int i = 0; i < cache->capacity; i++) cache->spare[i].key = PAIR_CACHE_EMPTY;
+	for (int i = 0; i < cache->capacity; i++) {
+		PairCacheEntry* entry = &cache->entries[i];
+		if (entry->key == PAIR_CACHE_EMPTY || entry->generation != cache->generation) continue;
+		InsertEntry(cache->spare, cache->capacity, *entry);
+	}
+
+	// Which thread found a new pair depends on the thread count, so new
+	// pairs go in by key to keep the table layout the same regardless
+	int added = 0;
+	for (int i = 0; i < cache->bufferCount; i++) added += cache->buffers[i].count;
+	if (added > 0) {
+		PairCacheEntry* merged = ArenaAlloc(cache->buffers[0].arena, sizeof(PairCacheEntry) * added);
+		int count = 0;
+		for (int i = 0; i < cache->bufferCount; i++) {
+			PairCacheBuffer* buf = &cache->buffers[i];
+			for (int j = 0; j < buf->count; j++) merged[count++] = buf->entries[j];
+			buf->count = 0;
+		}
+		qsort(merged, added, sizeof(PairCacheEntry), CompareEntryKeys);
+		for (int i = 0; i < added; i++) InsertEntry(cache->spare, cache->capacity, merged[i]);
+	}
+
+	PairCacheEntry* temp = cache->entries;
+	cache->entries = cache->spare;
+	cache->spare = temp;
+	cache->count = live;
+}
@@ -0,0 +1,89 @@
+// 
+// Persistent per-pair state keyed by collider handles
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef PAIRCACHE_H
+#define PAIRCACHE_H
+
+#include <raylib.h>
+#include "allocator.h"
+#include "arena.h"
+
+#define PAIR_CACHE_EMPTY 0xFFFFFFFFFFFFFFFFull
+
+typedef struct PairCacheEntry {
+	// Both handles packed with the smaller one in the high bits
+	unsigned long long key;
+
+	// Step the pair was last and first seen in
+	unsigned int generation;
+	unsigned int firstGeneration;
+
+	// Last narrowphase result, zero if the pair was not touching
+	Vector3 correction;
+} PairCacheEntry;
+
+// New pairs found by one thread during a step, in its scratch arena
+typedef struct PairCacheBuffer {
+	Arena* arena;
+	PairCacheEntry* entries;
+	int count;
+	int capacity;
+} PairCacheBuffer;
+
+// Open addressing with linear probing. Lookups during a step are
+// read-only, so threads can update existing entries in place and
+// queue new ones in their own buffer. At the end of the step live
+// entries and queued ones are rehashed into a spare table of the same
+// size, which drops every pair that was not seen during the step.
+typedef struct PairCache {
+	PairCacheEntry* entries;
+	PairCacheEntry* spare;
+	int capacity;
+	int count;
+
+	// Entries allocated for each table, more than the capacity after
+	// copying a smaller cache
+	int tableCapacity;
+
+	unsigned int generation;
+
+	PairCacheBuffer* buffers;
+	int bufferCount;
+
+	// Number of heap allocations ever made by the cache
+	int mallocCount;
+
+	ColliderAllocator allocator;
+} PairCache;
+
+PairCache CreatePairCache(int capacity);
+
+// Same as above, with all memory coming from the given allocator
+PairCache CreatePairCacheEx(int capacity, ColliderAllocator allocator);
+
+void FreePairCache(PairCache* cache);
+
+// Make dst an exact copy of src between steps. The tables only grow,
+// so copying back and forth stops allocating once dst has seen the
+// largest cache.
+void CopyPairCache(PairCache* dst, const PairCache* src);
+
+// Starts a new generation with one insertion buffer per thread,
+// each allocated from that thread's scratch arena
+void BeginPairCacheStep(PairCache* cache, Arena* arenas, int threadCount);
+
+// Entry for the pair, or NULL if it is not cached
+PairCacheEntry* PairCacheFind(PairCache* cache, unsigned int a, unsigned int b);
+
+// Mark the pair as seen and return its entry for writing. New pairs
+// get an entry in the thread's buffer. Each pair may only be touched
+// once per step, but different pairs can be touched concurrently.
+PairCacheEntry* PairCacheTouch(PairCache* cache, int thread, unsigned int a, unsigned int b);
+
+// Merge new pairs and evict any that were not touched this step
+void EndPairCacheStep(PairCache* cache);
+
+#endif
@@ -0,0 +1,250 @@
+// 
+// Overlap, nearest and sweep queries against a collider world
+//
+// 2023, Jonathan Tainer
+//
+
+#include "query.h"
+#include <raymath.h>
+#include <stddef.h>
+
+//*******************************************************************
+// Overlap queries. Broadphase finds candidate slots, then each shape
+// runs its own exact test before handing the collider to the caller.
+//*******************************************************************
+
+typedef struct OverlapContext {
+	ColliderWorld* world;
+	ColliderQueryFunc func;
+	void* user;
+	Collider* shape;
+	Vector3 center;
+	float radius;
+} OverlapContext;
+
+typedef struct QueryBuffer {
+	ColliderHandle* handles;
+	int maxCount;
+	int count;
+} QueryBuffer;
+
+static bool AppendQueryResult(ColliderHandle handle, void* user) {
+	QueryBuffer* buf = user;
+	if (buf->count < buf->maxCount) buf->handles[buf->count] = handle;
+	buf->count++;
+	return true;
+}
+
+static bool VisitCollider(int slot, void* user) {
+	OverlapContext* ctx = user;
+	if (!TestColliderPair(ctx->shape, &ctx->world->colliders[slot])) return true;
+	return ctx->func(ctx->world->slotHandle[slot], ctx->user);
+}
+
+static bool VisitSphere(int slot, void* user) {
+	OverlapContext* ctx = user;
+	Vector3 closest = GetColliderClosestPoint(&ctx->world->colliders[slot], ctx->center);
+	if (Vector3DistanceSqr(closest, ctx->center) > ctx->radius * ctx->radius) return true;
+	return ctx->func(ctx->world->slotHandle[slot], ctx->user);
+}
+
+// Bounds of a rotated collider can touch the box while the collider does
+// not, so the box is tested as an unrotated collider like any other shape
+void QueryWorldBoxEach(ColliderWorld* world, BoundingBox box, ColliderQueryFunc func, void* user) {
+	Collider shape = CreateCollider(box.min, box.max);
+	OverlapContext ctx = { .world = world, .func = func, .user = user, .shape = &shape };
+	HashGridQueryEach(&world->broadphase, box, VisitCollider, &ctx);
+}
+
+int QueryWorldBox(ColliderWorld* world, BoundingBox box, ColliderHandle* handles, int maxCount) {
+	QueryBuffer buf = { handles, maxCount, 0 };
+	QueryWorldBoxEach(world, box, AppendQueryResult, &buf);
+	return buf.count;
+}
+
+void QueryWorldColliderEach(ColliderWorld* world, Collider* shape, ColliderQueryFunc func, void* user) {
+	OverlapContext ctx = { .world = world, .func = func, .user = user, .shape = shape };
+	HashGridQueryEach(&world->broadphase, GetColliderBounds(shape), VisitCollider, &ctx);
+}
+
+int QueryWorldCollider(ColliderWorld* world, Collider* shape, ColliderHandle* handles, int maxCount) {
+	QueryBuffer buf = { handles, maxCount, 0 };
+	QueryWorldColliderEach(world, shape, AppendQueryResult, &buf);
+	return buf.count;
+}
+
+void QueryWorldSphereEach(ColliderWorld* world, Vector3 center, float radius, ColliderQueryFunc func, void* user) {
+	OverlapContext ctx = { .world = world, .func = func, .user = user, .center = center, .radius = radius };
+	Vector3 extent = { radius, radius, radius };
+	BoundingBox box = { Vector3Subtract(center, extent), Vector3Add(center, extent) };
+	HashGridQueryEach(&world->broadphase, box, VisitSphere, &ctx);
+}
+
+int QueryWorldSphere(ColliderWorld* world, Vector3 center, float radius, ColliderHandle* handles, int maxCount) {
+	QueryBuffer buf = { handles, maxCount, 0 };
+	QueryWorldSphereEach(world, center, radius, AppendQueryResult, &buf);
+	return buf.count;
+}
+
+//*******************************************************************
+// Nearest neighbors. The search box grows until the k-th closest
+// collider found is within it, since anything outside the box is
+// further away than its half size.
+//*******************************************************************
+
+typedef struct NearestContext {
+	ColliderWorld* world;
+	Vector3 point;
+	int k;
+	ColliderHandle* handles;
+	float* distances;
+	int found;
+	int visited;
+} NearestContext;
+
+// Insertion into a sorted list of at most k entries
+static bool VisitNearest(int slot, void* user) {
+	NearestContext* ctx = user;
+	ctx->visited++;
+	Vector3 closest = GetColliderClosestPoint(&ctx->world->colliders[slot], ctx->point);
+	float dist = Vector3Distance(closest, ctx->point);
+	if (ctx->found == ctx->k && dist >= ctx->distances[ctx->k - 1]) return true;
+
+	int i = ctx->found < ctx->k ? ctx->found++ : ctx->k - 1;
+	while (i > 0 && ctx->distances[i - 1] > dist) {
+		ctx->distances[i] = ctx->distances[i - 1];
+		ctx->handles[i] = ctx->handles[i - 1];
+		i--;
+	}
+	ctx->distances[i] = dist;
+	ctx->handles[i] = ctx->world->slotHandle[slot];
+	return true;
+}
+
+int QueryWorldNearest(ColliderWorld* world, Vector3 point, int k, ColliderHandle* handles, float* distances) {
+	if (k <= 0 || world->count == 0) return 0;
+
+	NearestContext ctx = { world, point, k, handles, distances, 0, 0 };
+	float radius = world->broadphase.cellSize;
+	for (;;) {
+		ctx.found = 0;
+		ctx.visited = 0;
+		Vector3 extent = { radius, radius, radius };
+		BoundingBox box = { Vector3Subtract(point, extent), Vector3Add(point, extent) };
+		HashGridQueryEach(&world->broadphase, box, VisitNearest, &ctx);
+
+		// An infinite box takes in every level whole, so doubling ends
+		// there even if colliders are out of reach of any finite one
+		if (ctx.found == k && distances[k - 1] <= radius) break;
+		if (ctx.visited == world->count || isinf(radius)) break;
+		radius *= 2.f;
+	}
+	return ctx.found;
+}
+
+//*******************************************************************
+// Sweeps. The broadphase is queried with the box enclosing the whole
+// motion, then each candidate gets an exact swept separating axis test.
+//*******************************************************************
+
+typedef struct SweepContext {
+	ColliderWorld* world;
+	Collider* shape;
+	Vector3 disp;
+	ColliderSweepFunc func;
+	void* user;
+} SweepContext;
+
+static bool VisitSweep(int slot, void* user) {
+	SweepContext* ctx = user;
+	ColliderSweepHit hit = { ctx->world->slotHandle[slot], 0.f, { 0.f, 0.f, 0.f } };
+	if (!SweepColliderPair(ctx->shape, ctx->disp, &ctx->world->colliders[slot], &hit.time, &hit.normal)) return true;
+	return ctx->func(hit, ctx->user);
+}
+
+void SweepWorldColliderEach(ColliderWorld* world, Collider* shape, Vector3 disp, ColliderSweepFunc func, void* user) {
+	BoundingBox box = GetColliderBounds(shape);
+	box.min = Vector3Add(box.min, Vector3Min(disp, Vector3Zero()));
+	box.max = Vector3Add(box.max, Vector3Max(disp, Vector3Zero()));
+
+	SweepContext ctx = { world, shape, disp, func, user };
+	HashGridQueryEach(&world->broadphase, box, VisitSweep, &ctx);
+}
+
+static bool KeepFirstHit(ColliderSweepHit hit, void* user) {
+	ColliderSweepHit* first = user;
+	if (first->handle == COLLIDER_HANDLE_INVALID || hit.time < first->time) *first = hit;
+	return true;
+}
+
+bool SweepWorldCollider(ColliderWorld* world, Collider* shape, Vector3 disp, ColliderSweepHit* hit) {
+	ColliderSweepHit first = { COLLIDER_HANDLE_INVALID, 1.f, { 0.f, 0.f, 0.f } };
+	SweepWorldColliderEach(world, shape, disp, KeepFirstHit, &first);
+	if (first.handle == COLLIDER_HANDLE_INVALID) return false;
+	*hit = first;
+	return true;
+}
+
+typedef struct SweepBatch {
+	ColliderWorld* world;
+	Collider* shape;
+	const Matrix* starts;
+	const Vector3* disps;
+	ColliderSweepHit* hits;
+} SweepBatch;
+
+// Queries only read the world, so chunks can run concurrently
+static void RunSweepBatch(int begin, int end, int thread, void* user) {
+	(void) thread;
+	SweepBatch* batch = user;
+	Collider shape = *batch->shape;
+	for (int i = begin; i < end; i++) {
+		SetColliderTransform(&shape, batch->starts[i]);
+		if (!SweepWorldCollider(batch->world, &shape, batch->disps[i], &batch->hits[i])) {
+			batch->hits[i] = (ColliderSweepHit) { COLLIDER_HANDLE_INVALID, 1.f, { 0.f, 0.f, 0.f } };
+		}
+	}
+}
+
+void SweepWorldColliderBatch(ColliderWorld* world, ThreadPool* pool, Collider* shape,
+	const Matrix* starts, const Vector3* disps, int count, ColliderSweepHit* hits) {
+	SweepBatch batch = { world, shape, starts, disps, hits };
+	ThreadPoolFor(pool, count, 16, RunSweepBatch, &batch);
+}
+
+//*******************************************************************
+// Distance between world colliders for proximity sensors
+//*******************************************************************
+
+typedef struct DistanceBatch {
+	ColliderWorld* world;
+	const ColliderHandle* a;
+	const ColliderHandle* b;
+	float* distances;
+	Vector3* pointsA;
+	Vector3* pointsB;
+} DistanceBatch;
+
+static void RunDistanceBatch(int begin, int end, int thread, void* user) {
+	(void) thread;
+	DistanceBatch* batch = user;
+	for (int i = begin; i < end; i++) {
+		Collider* a = PeekWorldCollider(batch->world, batch->a[i]);
+		Collider* b = PeekWorldCollider(batch->world, batch->b[i]);
+		if (!a || !b) {
+			batch->distances[i] = -1.f;
+			if (batch->pointsA) batch->pointsA[i] = Vector3Zero();
+			if (batch->pointsB) batch->pointsB[i] = Vector3Zero();
+			continue;
+		}
+		batch->distances[i] = GetColliderDistance(a, b,
+			batch->pointsA ? &batch->pointsA[i] : NULL,
+			batch->pointsB ? &batch->pointsB[i] : NULL);
+	}
+}
+
+void GetWorldDistanceBatch(ColliderWorld* world, ThreadPool* pool, const ColliderHandle* a, const ColliderHandle* b,
+	int count, float* distances, Vector3* pointsA, Vector3* pointsB) {
+	DistanceBatch batch = { world, a, b, distances, pointsA, pointsB };
+	ThreadPoolFor(pool, count, 32, RunDistanceBatch, &batch);
+}
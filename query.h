@@ -0,0 +1,66 @@
+// 
+// Overlap, nearest and sweep queries against a collider world
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "world.h"
+#include "threadpool.h"
+
+// Queries use the bounds and broadphase as of the last step or add,
+// and never allocate. Buffer variants write up to maxCount handles and
+// return the total number found, which may be larger than maxCount.
+
+// Return false to stop the query early
+typedef bool (*ColliderQueryFunc)(ColliderHandle handle, void* user);
+
+typedef struct ColliderSweepHit {
+	ColliderHandle handle;
+
+	// Fraction of the displacement travelled before contact
+	float time;
+
+	// Surface normal of the collider that was hit
+	Vector3 normal;
+} ColliderSweepHit;
+
+typedef bool (*ColliderSweepFunc)(ColliderSweepHit hit, void* user);
+
+// Colliders overlapping an axis-aligned box
+int QueryWorldBox(ColliderWorld* world, BoundingBox box, ColliderHandle* handles, int maxCount);
+void QueryWorldBoxEach(ColliderWorld* world, BoundingBox box, ColliderQueryFunc func, void* user);
+
+// Colliders overlapping an oriented box, which does not need to be in the world
+int QueryWorldCollider(ColliderWorld* world, Collider* shape, ColliderHandle* handles, int maxCount);
+void QueryWorldColliderEach(ColliderWorld* world, Collider* shape, ColliderQueryFunc func, void* user);
+
+// Colliders overlapping a sphere
+int QueryWorldSphere(ColliderWorld* world, Vector3 center, float radius, ColliderHandle* handles, int maxCount);
+void QueryWorldSphereEach(ColliderWorld* world, Vector3 center, float radius, ColliderQueryFunc func, void* user);
+
+// Up to k colliders closest to a point, nearest first
+// Both buffers hold k entries, distance is zero for colliders containing the point
+int QueryWorldNearest(ColliderWorld* world, Vector3 point, int k, ColliderHandle* handles, float* distances);
+
+// First collider hit when moving a shape by 'disp'
+bool SweepWorldCollider(ColliderWorld* world, Collider* shape, Vector3 disp, ColliderSweepHit* hit);
+
+// Every collider hit along the way, in no particular order
+void SweepWorldColliderEach(ColliderWorld* world, Collider* shape, Vector3 disp, ColliderSweepFunc func, void* user);
+
+// Separation and closest points for each pair of handles, split across
+// the pool (which may be NULL). Point arrays may be NULL. Pairs with a
+// stale handle get a distance of -1 and zero points.
+void GetWorldDistanceBatch(ColliderWorld* world, ThreadPool* pool, const ColliderHandle* a, const ColliderHandle* b,
+	int count, float* distances, Vector3* pointsA, Vector3* pointsB);
+
+// Sweep copies of one shape from each start transform by the matching
+// displacement, split across the pool (which may be NULL). Sweeps that
+// hit nothing get an invalid handle and a time of one.
+void SweepWorldColliderBatch(ColliderWorld* world, ThreadPool* pool, Collider* shape,
+	const Matrix* starts, const Vector3* disps, int count, ColliderSweepHit* hits);
+
+#endif
@@ -0,0 +1,359 @@
+// 
+// Recording and replay of collider motion for benchmarks
+//
+// 2023, Jonathan Tainer
+//
+
+#include "record.h"
+#include <raymath.h>
+#include <string.h>
+
+typedef enum RecordType {
+	RECORD_ADD,
+	RECORD_REMOVE,
+	RECORD_FILTER,
+	RECORD_TRANSFORM,
+} RecordType;
+
+//*******************************************************************
+// Encoding
+//*******************************************************************
+
+static void ReserveBuffer(ColliderRecorder* recorder, size_t extra) {
+	size_t needed = recorder->bufferSize + extra;
+	if (needed <= recorder->bufferCapacity) return;
+	size_t capacity = recorder->bufferCapacity ? recorder->bufferCapacity : 4096;
+	while (capacity < needed) capacity *= 2;
+	recorder->buffer = AllocatorRealloc(&recorder->allocator, recorder->buffer, capacity);
+	recorder->bufferCapacity = capacity;
+}
+
+// Seven bits per byte, high bit set on all but the last
+static void PutVarint(ColliderRecorder* recorder, unsigned long long value) {
+	ReserveBuffer(recorder, 10);
+	while (value >= 0x80) {
+		recorder->buffer[recorder->bufferSize++] = (unsigned char) (value | 0x80);
+		value >>= 7;
+	}
+	recorder->buffer[recorder->bufferSize++] = (unsigned char) value;
+}
+
+// Zigzag keeps small negative numbers small
+static void PutSigned(ColliderRecorder* recorder, long long value) {
+	PutVarint(recorder, ((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63));
+}
+
+static void PutBytes(ColliderRecorder* recorder, const void* data, size_t size) {
+	ReserveBuffer(recorder, size);
+	memcpy(recorder->buffer + recorder->bufferSize, data, size);
+	recorder->bufferSize += size;
+}
+
+typedef struct Reader {
+	const unsigned char* data;
+	size_t size;
+	size_t pos;
+	bool failed;
+} Reader;
+
+static unsigned long long GetVarint(Reader* reader) {
+	unsigned long long value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (reader->pos >= reader->size) break;
+		unsigned char byte = reader->data[reader->pos++];
+		value |= (unsigned long long) (byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return value;
+	}
+	reader->failed = true;
+	return 0;
+}
+
+static long long GetSigned(Reader* reader) {
+	unsigned long long value = GetVarint(reader);
+	return (long long) (value >> 1) ^ -(long long) (value & 1);
+}
+
+static void GetBytes(Reader* reader, void* data, size_t size) {
+	if (reader->size - reader->pos < size) {
+		reader->failed = true;
+		memset(data, 0, size);
+		return;
+	}
+	memcpy(data, reader->data + reader->pos, size);
+	reader->pos += size;
+}
+
+//*******************************************************************
+// Quantization
+//*******************************************************************
+
+static void QuantizePose(Collider* col, float precision, long long position[3], long long rotation[4]) {
+	Quaternion q = QuaternionFromMatrix(col->matRotate);
+
+	// q and -q are the same rotation, pick one so deltas stay small
+	if (q.w < 0.f) q = (Quaternion) { -q.x, -q.y, -q.z, -q.w };
+	position[0] = llroundf(col->matTranslate.m12 / precision);
+	position[1] = llroundf(col->matTranslate.m13 / precision);
+	position[2] = llroundf(col->matTranslate.m14 / precision);
+	rotation[0] = llroundf(q.x * RECORDING_ROTATION_SCALE);
+	rotation[1] = llroundf(q.y * RECORDING_ROTATION_SCALE);
+	rotation[2] = llroundf(q.z * RECORDING_ROTATION_SCALE);
+	rotation[3] = llroundf(q.w * RECORDING_ROTATION_SCALE);
+}
+
+static Matrix GetRecordedTransform(RecordedCollider* rec, float precision) {
+	Quaternion q = {
+		rec->rotation[0] / RECORDING_ROTATION_SCALE,
+		rec->rotation[1] / RECORDING_ROTATION_SCALE,
+		rec->rotation[2] / RECORDING_ROTATION_SCALE,
+		rec->rotation[3] / RECORDING_ROTATION_SCALE,
+	};
+	Matrix transform = QuaternionToMatrix(QuaternionNormalize(q));
+	transform.m12 = rec->position[0] * precision;
+	transform.m13 = rec->position[1] * precision;
+	transform.m14 = rec->position[2] * precision;
+	return transform;
+}
+
+static void ReserveRecorded(RecordedCollider** colliders, int* capacity, int needed, ColliderAllocator* allocator) {
+	if (needed <= *capacity) return;
+	int newCapacity = *capacity ? *capacity : 64;
+	while (newCapacity < needed) newCapacity *= 2;
+	*colliders = AllocatorRealloc(allocator, *colliders, sizeof(RecordedCollider) * newCapacity);
+	for (int i = *capacity; i < newCapacity; i++) (*colliders)[i].handle = COLLIDER_HANDLE_INVALID;
+	*capacity = newCapacity;
+}
+
+//*******************************************************************
+// Recording
+//*******************************************************************
+
+ColliderRecorder* OpenColliderRecorder(const char* path, ColliderWorld* world, float precision) {
+	FILE* file = fopen(path, "wb");
+	if (!file) return NULL;
+	ColliderRecorder* recorder = AllocatorMalloc(&world->allocator, sizeof(ColliderRecorder));
+	*recorder = (ColliderRecorder) { 0 };
+	recorder->file = file;
+	recorder->precision = precision > 0.f ? precision : 0.001f;
+	recorder->allocator = world->allocator;
+
+	unsigned int version = RECORDING_VERSION;
+	fwrite(RECORDING_MAGIC, 1, 4, file);
+	fwrite(&version, sizeof(version), 1, file);
+	fwrite(&recorder->precision, sizeof(float), 1, file);
+	recorder->bytesWritten = 4 + sizeof(version) + sizeof(float);
+	return recorder;
+}
+
+void CloseColliderRecorder(ColliderRecorder* recorder) {
+	if (!recorder) return;
+	fclose(recorder->file);
+	ColliderAllocator allocator = recorder->allocator;
+	AllocatorFree(&allocator, recorder->colliders);
+	AllocatorFree(&allocator, recorder->buffer);
+	AllocatorFree(&allocator, recorder);
+}
+
+static void PutFilter(ColliderRecorder* recorder, ColliderFilter filter, unsigned int flags) {
+	PutVarint(recorder, filter.category);
+	PutVarint(recorder, filter.mask);
+	PutSigned(recorder, filter.group);
+	PutVarint(recorder, flags);
+}
+
+// Live handle at a handle index, free entries hold a free list link
+// instead of a slot so they are checked against the slot's handle
+static ColliderHandle GetLiveHandle(ColliderWorld* world, int index) {
+	if (index >= world->handleCount) return COLLIDER_HANDLE_INVALID;
+	int slot = world->handleSlot[index];
+	if (slot < 0 || slot >= world->count) return COLLIDER_HANDLE_INVALID;
+	ColliderHandle handle = world->slotHandle[slot];
+	return (handle & COLLIDER_HANDLE_INDEX_MASK) == (unsigned int) index ? handle : COLLIDER_HANDLE_INVALID;
+}
+
+bool RecordColliderTick(ColliderRecorder* recorder, ColliderWorld* world) {
+	ReserveRecorded(&recorder->colliders, &recorder->capacity, world->handleCount, &recorder->allocator);
+	recorder->bufferSize = 0;
+
+	// Records go out in handle index order, so each index is a small delta
+	int prevIndex = 0;
+	for (int index = 0; index < recorder->capacity; index++) {
+		RecordedCollider* rec = &recorder->colliders[index];
+		ColliderHandle handle = GetLiveHandle(world, index);
+		if (handle == COLLIDER_HANDLE_INVALID && rec->handle == COLLIDER_HANDLE_INVALID) continue;
+
+		// Removed, or removed and the index reused within the tick
+		if (rec->handle != COLLIDER_HANDLE_INVALID && rec->handle != handle) {
+			PutBytes(recorder, &(unsigned char) { RECORD_REMOVE }, 1);
+			PutVarint(recorder, index - prevIndex);
+			prevIndex = index;
+			rec->handle = COLLIDER_HANDLE_INVALID;
+		}
+		if (handle == COLLIDER_HANDLE_INVALID) continue;
+
+		int slot = world->handleSlot[index];
+		Collider* col = &world->colliders[slot];
+		ColliderFilter filter = world->filters[slot];
+		unsigned int flags = world->flags[slot];
+		long long position[3], rotation[4];
+		QuantizePose(col, recorder->precision, position, rotation);
+
+		if (rec->handle == COLLIDER_HANDLE_INVALID) {
+			PutBytes(recorder, &(unsigned char) { RECORD_ADD }, 1);
+			PutVarint(recorder, index - prevIndex);
+			PutBytes(recorder, col->vertLocal, sizeof(col->vertLocal));
+			for (int i = 0; i < 3; i++) PutSigned(recorder, position[i]);
+			for (int i = 0; i < 4; i++) PutSigned(recorder, rotation[i]);
+			PutFilter(recorder, filter, flags);
+		}
+		else {
+			if (memcmp(&filter, &rec->filter, sizeof(filter)) != 0 || flags != rec->flags) {
+				PutBytes(recorder, &(unsigned char) { RECORD_FILTER }, 1);
+				PutVarint(recorder, index - prevIndex);
+				PutFilter(recorder, filter, flags);
+				prevIndex = index;
+				rec->filter = filter;
+				rec->flags = flags;
+			}
+			if (memcmp(position, rec->position, sizeof(position)) == 0
+				&& memcmp(rotation, rec->rotation, sizeof(rotation)) == 0) continue;
+			PutBytes(recorder, &(unsigned char) { RECORD_TRANSFORM }, 1);
+			PutVarint(recorder, index - prevIndex);
+			for (int i = 0; i < 3; i++) PutSigned(recorder, position[i] - rec->position[i]);
+			for (int i = 0; i < 4; i++) PutSigned(recorder, rotation[i] - rec->rotation[i]);
+		}
+		prevIndex = index;
+		rec->handle = handle;
+		memcpy(rec->position, position, sizeof(position));
+		memcpy(rec->rotation, rotation, sizeof(rotation));
+		rec->filter = filter;
+		rec->flags = flags;
+	}
+
+	// Each tick is its length followed by its records, the length is
+	// encoded after the records and written first
+	size_t records = recorder->bufferSize;
+	PutVarint(recorder, records);
+	size_t prefix = recorder->bufferSize - records;
+	bool ok = fwrite(recorder->buffer + records, 1, prefix, recorder->file) == prefix;
+	ok = ok && fwrite(recorder->buffer, 1, records, recorder->file) == records;
+	recorder->bytesWritten += prefix + records;
+	recorder->tickCount++;
+	return ok;
+}
+
+//*******************************************************************
+// Replay
+//*******************************************************************
+
+ColliderReplay* OpenColliderReplay(const char* path, ColliderWorld* world) {
+	FILE* file = fopen(path, "rb");
+	if (!file) return NULL;
+	char magic[4];
+	unsigned int version;
+	float precision;
+	if (fread(magic, 1, 4, file) != 4 || memcmp(magic, RECORDING_MAGIC, 4) != 0
+		|| fread(&version, sizeof(version), 1, file) != 1 || version != RECORDING_VERSION
+		|| fread(&precision, sizeof(float), 1, file) != 1 || !(precision > 0.f)) {
+		fclose(file);
+		return NULL;
+	}
+
+	ColliderReplay* replay = AllocatorMalloc(&world->allocator, sizeof(ColliderReplay));
+	*replay = (ColliderReplay) { 0 };
+	replay->file = file;
+	replay->precision = precision;
+	replay->allocator = world->allocator;
+	return replay;
+}
+
+void CloseColliderReplay(ColliderReplay* replay) {
+	if (!replay) return;
+	fclose(replay->file);
+	ColliderAllocator allocator = replay->allocator;
+	AllocatorFree(&allocator, replay->colliders);
+	AllocatorFree(&allocator, replay->buffer);
+	AllocatorFree(&allocator, replay);
+}
+
+static bool ReadTickSize(FILE* file, size_t* size) {
+	unsigned long long value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		int byte = fgetc(file);
+		if (byte == EOF) return false;
+		value |= (unsigned long long) (byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*size = (size_t) value;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void GetFilter(Reader* reader, RecordedCollider* rec) {
+	rec->filter.category = (unsigned int) GetVarint(reader);
+	rec->filter.mask = (unsigned int) GetVarint(reader);
+	rec->filter.group = (int) GetSigned(reader);
+	rec->flags = (unsigned int) GetVarint(reader);
+}
+
+static void ApplyFilter(ColliderWorld* world, RecordedCollider* rec) {
+	SetWorldColliderFilter(world, rec->handle, rec->filter);
+	SetWorldColliderTrigger(world, rec->handle, rec->flags & COLLIDER_FLAG_TRIGGER);
+}
+
+bool ReplayColliderTick(ColliderReplay* replay, ColliderWorld* world) {
+	size_t size;
+	if (!ReadTickSize(replay->file, &size)) return false;
+	if (size > replay->bufferCapacity) {
+		replay->buffer = AllocatorRealloc(&replay->allocator, replay->buffer, size);
+		replay->bufferCapacity = size;
+	}
+	if (size > 0 && fread(replay->buffer, 1, size, replay->file) != size) return false;
+
+	Reader reader = { replay->buffer, size, 0, false };
+	int index = 0;
+	while (reader.pos < reader.size && !reader.failed) {
+		RecordType type = reader.data[reader.pos++];
+		unsigned long long delta = GetVarint(&reader);
+		if (delta > COLLIDER_HANDLE_MAX_INDEX - (unsigned long long) index) return false;
+		index += (int) delta;
+		ReserveRecorded(&replay->colliders, &replay->capacity, index + 1, &replay->allocator);
+		RecordedCollider* rec = &replay->colliders[index];
+
+		switch (type) {
+		case RECORD_ADD: {
+			Collider col = { 0 };
+			GetBytes(&reader, col.vertLocal, sizeof(col.vertLocal));
+			for (int i = 0; i < 3; i++) rec->position[i] = GetSigned(&reader);
+			for (int i = 0; i < 4; i++) rec->rotation[i] = GetSigned(&reader);
+			GetFilter(&reader, rec);
+			SetColliderTransform(&col, GetRecordedTransform(rec, replay->precision));
+			rec->handle = AddWorldCollider(world, col);
+			ApplyFilter(world, rec);
+		} break;
+
+		case RECORD_REMOVE:
+			RemoveWorldCollider(world, rec->handle);
+			rec->handle = COLLIDER_HANDLE_INVALID;
+			break;
+
+		case RECORD_FILTER:
+			GetFilter(&reader, rec);
+			ApplyFilter(world, rec);
+			break;
+
+		case RECORD_TRANSFORM:
+			for (int i = 0; i < 3; i++) rec->position[i] += GetSigned(&reader);
+			for (int i = 0; i < 4; i++) rec->rotation[i] += GetSigned(&reader);
+			SetWorldColliderTransform(world, rec->handle, GetRecordedTransform(rec, replay->precision));
+			break;
+
+		default:
+			return false;
+		}
+	}
+	if (reader.failed) return false;
+	replay->tickCount++;
+	return true;
+}
@@ -0,0 +1,88 @@
+// 
+// Recording and replay of collider motion for benchmarks
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "world.h"
+#include <stdio.h>
+
+#define RECORDING_MAGIC "OBBR"
+#define RECORDING_VERSION 1
+
+// Rotation components are stored in steps of one over this
+#define RECORDING_ROTATION_SCALE 32767.f
+
+// Last value written for one handle index, positions and rotations quantized
+typedef struct RecordedCollider {
+	ColliderHandle handle;
+	long long position[3];
+	long long rotation[4];
+	ColliderFilter filter;
+	unsigned int flags;
+} RecordedCollider;
+
+// Each tick is diffed against the last, so colliders added, removed,
+// refiltered or moved by any means, directly or through a command
+// queue, are written as commands. Colliders that did not move cost
+// nothing and moving ones cost a few bytes of quantized deltas.
+// Attached colliders are recorded at their global placement, so a
+// replay has no hierarchy.
+typedef struct ColliderRecorder {
+	FILE* file;
+
+	// Size in world units of one step of recorded position
+	float precision;
+
+	RecordedCollider* colliders;
+	int capacity;
+
+	// Encoded tick records, with the length prefix appended after them
+	unsigned char* buffer;
+	size_t bufferSize;
+	size_t bufferCapacity;
+
+	int tickCount;
+	size_t bytesWritten;
+	ColliderAllocator allocator;
+} ColliderRecorder;
+
+// Reads a recording back one tick at a time, so it can be far larger
+// than memory. Recorded handles are mapped to the handles the replay
+// world hands out.
+typedef struct ColliderReplay {
+	FILE* file;
+	float precision;
+
+	RecordedCollider* colliders;
+	int capacity;
+
+	unsigned char* buffer;
+	size_t bufferCapacity;
+
+	int tickCount;
+	ColliderAllocator allocator;
+} ColliderReplay;
+
+// NULL if the file cannot be created
+ColliderRecorder* OpenColliderRecorder(const char* path, ColliderWorld* world, float precision);
+
+void CloseColliderRecorder(ColliderRecorder* recorder);
+
+// Call after each step, this captures what the step saw
+bool RecordColliderTick(ColliderRecorder* recorder, ColliderWorld* world);
+
+// NULL if the file is missing or not a recording
+ColliderReplay* OpenColliderReplay(const char* path, ColliderWorld* world);
+
+void CloseColliderReplay(ColliderReplay* replay);
+
+// Apply the next tick's changes to the world without stepping it, so
+// the caller steps and times the step alone. Returns false at the end
+// of the recording or if the file is damaged.
+bool ReplayColliderTick(ColliderReplay* replay, ColliderWorld* world);
+
+#endif
@@ -0,0 +1,73 @@
+// 
+// Ring of saved world states for rollback networking
+//
+// 2023, Jonathan Tainer
+//
+
+#include "rollback.h"
+
+static int GetFrameSlot(ColliderRollback* rollback, int frame) {
+	int slot = frame % rollback->frameCount;
+	return slot < 0 ? slot + rollback->frameCount : slot;
+}
+
+static void FreeState(ColliderWorld* state) {
+	ColliderAllocator* allocator = &state->allocator;
+	AllocatorFree(allocator, state->colliders);
+	AllocatorFree(allocator, state->bounds);
+	AllocatorFree(allocator, state->filters);
+	AllocatorFree(allocator, state->flags);
+	AllocatorFree(allocator, state->slotHandle);
+	AllocatorFree(allocator, state->handleSlot);
+	AllocatorFree(allocator, state->handleGeneration);
+	AllocatorFree(allocator, state->parentHandle);
+	AllocatorFree(allocator, state->childCount);
+	AllocatorFree(allocator, state->localTransform);
+	AllocatorFree(allocator, state->transformDirty);
+	AllocatorFree(allocator, state->handleMoved);
+	AllocatorFree(allocator, state->movedHandles);
+	AllocatorFree(allocator, state->hierarchyOrder);
+	AllocatorFree(allocator, state->triggerPairs);
+	FreeHashGrid(&state->broadphase);
+	FreePairCache(&state->pairCache);
+}
+
+ColliderRollback CreateColliderRollback(ColliderWorld* world, int frameCount) {
+	ColliderRollback rollback = { 0 };
+	rollback.allocator = world->allocator;
+	rollback.frameCount = frameCount < 1 ? 1 : frameCount;
+	rollback.states = AllocatorMalloc(&rollback.allocator, sizeof(ColliderWorld) * rollback.frameCount);
+	rollback.frames = AllocatorMalloc(&rollback.allocator, sizeof(int) * rollback.frameCount);
+
+	// Copying the world in once sizes every slot up front
+	for (int i = 0; i < rollback.frameCount; i++) {
+		ColliderWorld* state = &rollback.states[i];
+		*state = (ColliderWorld) { 0 };
+		state->allocator = world->allocator;
+		state->broadphase = CreateHashGridEx(world->broadphase.cellSize, 1, world->allocator);
+		state->pairCache.allocator = world->allocator;
+		CopyColliderWorldState(state, world);
+		rollback.frames[i] = -1;
+	}
+	return rollback;
+}
+
+void FreeColliderRollback(ColliderRollback* rollback) {
+	for (int i = 0; i < rollback->frameCount; i++) FreeState(&rollback->states[i]);
+	AllocatorFree(&rollback->allocator, rollback->states);
+	AllocatorFree(&rollback->allocator, rollback->frames);
+	*rollback = (ColliderRollback) { 0 };
+}
+
+void SaveWorldFrame(ColliderRollback* rollback, ColliderWorld* world, int frame) {
+	int slot = GetFrameSlot(rollback, frame);
+	CopyColliderWorldState(&rollback->states[slot], world);
+	rollback->frames[slot] = frame;
+}
+
+bool RestoreWorldFrame(ColliderRollback* rollback, ColliderWorld* world, int frame) {
+	int slot = GetFrameSlot(rollback, frame);
+	if (rollback->frames[slot] != frame) return false;
+	CopyColliderWorldState(world, &rollback->states[slot]);
+	return true;
+}
@@ -0,0 +1,37 @@
+// 
+// Ring of saved world states for rollback networking
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include "world.h"
+
+// Holds the last few frames of a world. Each slot keeps its memory
+// from one save to the next, so saving and restoring a world that is
+// not growing is just copying arrays.
+typedef struct ColliderRollback {
+	// Only the state copied by CopyColliderWorldState is used
+	ColliderWorld* states;
+
+	// Frame number saved in each slot, -1 if empty
+	int* frames;
+	int frameCount;
+
+	ColliderAllocator allocator;
+} ColliderRollback;
+
+// Slots are sized for the world as it is now
+ColliderRollback CreateColliderRollback(ColliderWorld* world, int frameCount);
+
+void FreeColliderRollback(ColliderRollback* rollback);
+
+// Overwrites whatever frame was saved frameCount frames earlier
+void SaveWorldFrame(ColliderRollback* rollback, ColliderWorld* world, int frame);
+
+// Returns false if the frame is no longer in the ring
+bool RestoreWorldFrame(ColliderRollback* rollback, ColliderWorld* world, int frame);
+
+#endif
@@ -0,0 +1,401 @@
+// 
+// Binary scene files loaded by memory mapping
+//
+// 2023, Jonathan Tainer
+//
+
+#define _POSIX_C_SOURCE 200809L
+
+// madvise, since posix_madvise ignores POSIX_MADV_DONTNEED on glibc
+#define _DEFAULT_SOURCE
+
+#include "scene.h"
+#include <raymath.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//*******************************************************************
+// Writing
+//*******************************************************************
+
+// Places a section at the next aligned offset
+static SceneSection PlaceSection(unsigned long long* end, unsigned long long count, size_t size) {
+	SceneSection section = { (*end + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT, count };
+	*end = section.offset + count * size;
+	return section;
+}
+
+static bool WriteSection(FILE* file, SceneSection section, const void* data, size_t size) {
+	static const char zeros[SCENE_ALIGNMENT] = { 0 };
+	long pad = (long) section.offset - ftell(file);
+	if (pad > 0 && fwrite(zeros, 1, pad, file) != (size_t) pad) return false;
+	return section.count == 0 || fwrite(data, size, section.count, file) == section.count;
+}
+
+// Chunk cell of an instance, with its index to keep the sort stable
+typedef struct ChunkKey {
+	int cell[3];
+	int index;
+} ChunkKey;
+
+static int CompareChunkKeys(const void* a, const void* b) {
+	const ChunkKey* ka = a;
+	const ChunkKey* kb = b;
+	for (int i = 0; i < 3; i++) {
+		if (ka->cell[i] != kb->cell[i]) return ka->cell[i] < kb->cell[i] ? -1 : 1;
+	}
+	return ka->index < kb->index ? -1 : ka->index > kb->index;
+}
+
+static bool IsSameChunk(const ChunkKey* a, const ChunkKey* b) {
+	return a->cell[0] == b->cell[0] && a->cell[1] == b->cell[1] && a->cell[2] == b->cell[2];
+}
+
+bool SaveColliderScene(const char* path, float cellSize, float chunkSize, const SceneShape* shapes, int shapeCount,
+	const SceneInstance* instances, int instanceCount, const SceneLayer* layers, int layerCount) {
+	if (instanceCount > (int) COLLIDER_HANDLE_MAX_INDEX + 1) return false;
+	for (int i = 0; i < instanceCount; i++) {
+		if (instances[i].shape >= (unsigned int) shapeCount || instances[i].layer >= (unsigned int) layerCount) return false;
+	}
+	int count = instanceCount;
+	int size = count ? count : 1;
+	ChunkKey* keys = malloc(sizeof(ChunkKey) * size);
+	SceneInstance* sorted = malloc(sizeof(SceneInstance) * size);
+	SceneChunk* chunks = malloc(sizeof(SceneChunk) * size);
+	Collider* colliders = malloc(sizeof(Collider) * size);
+	BoundingBox* bounds = malloc(sizeof(BoundingBox) * size);
+	ColliderFilter* filters = malloc(sizeof(ColliderFilter) * size);
+	unsigned int* zeros = calloc(size, sizeof(unsigned int));
+	unsigned int* identity = malloc(sizeof(unsigned int) * size);
+	HashGrid grid = CreateHashGrid(cellSize, count);
+
+	// Bake exactly what AddWorldCollider would store
+	for (int i = 0; i < count; i++) {
+		const SceneInstance* instance = &instances[i];
+		const SceneShape* shape = &shapes[instance->shape];
+		colliders[i] = CreateCollider(shape->min, shape->max);
+		Matrix transform = QuaternionToMatrix(instance->rotation);
+		transform.m12 = instance->position.x;
+		transform.m13 = instance->position.y;
+		transform.m14 = instance->position.z;
+		SetColliderTransform(&colliders[i], transform);
+		bounds[i] = GetColliderBounds(&colliders[i]);
+
+		// Chunk by the center of the bounds, everything in one chunk if size is zero
+		Vector3 center = Vector3Scale(Vector3Add(bounds[i].min, bounds[i].max), 0.5f);
+		keys[i] = (ChunkKey) { { 0, 0, 0 }, i };
+		if (chunkSize > 0.f) {
+			keys[i].cell[0] = (int) floorf(center.x / chunkSize);
+			keys[i].cell[1] = (int) floorf(center.y / chunkSize);
+			keys[i].cell[2] = (int) floorf(center.z / chunkSize);
+		}
+	}
+
+	// Store each chunk's colliders contiguously so it pages in as a block
+	qsort(keys, count, sizeof(ChunkKey), CompareChunkKeys);
+	Collider* unsorted = colliders;
+	colliders = malloc(sizeof(Collider) * size);
+	int chunkCount = 0;
+	for (int i = 0; i < count; i++) {
+		int source = keys[i].index;
+		sorted[i] = instances[source];
+		colliders[i] = unsorted[source];
+		bounds[i] = GetColliderBounds(&colliders[i]);
+		filters[i] = layers[sorted[i].layer].filter;
+		identity[i] = i;
+		HashGridInsert(&grid, i, bounds[i]);
+
+		if (i == 0 || !IsSameChunk(&keys[i], &keys[i - 1])) {
+			chunks[chunkCount++] = (SceneChunk) { bounds[i], i, 0 };
+		}
+		SceneChunk* chunk = &chunks[chunkCount - 1];
+		chunk->bounds.min = Vector3Min(chunk->bounds.min, bounds[i].min);
+		chunk->bounds.max = Vector3Max(chunk->bounds.max, bounds[i].max);
+		chunk->count++;
+	}
+	free(unsorted);
+
+	SceneHeader header = { 0 };
+	memcpy(header.magic, SCENE_MAGIC, 4);
+	header.version = SCENE_VERSION;
+	header.colliderSize = sizeof(Collider);
+	header.gridEntrySize = sizeof(HashGridEntry);
+	unsigned long long end = sizeof(SceneHeader);
+	header.shapes = PlaceSection(&end, shapeCount, sizeof(SceneShape));
+	header.instances = PlaceSection(&end, count, sizeof(SceneInstance));
+	header.layers = PlaceSection(&end, layerCount, sizeof(SceneLayer));
+	header.chunks = PlaceSection(&end, chunkCount, sizeof(SceneChunk));
+	header.colliders = PlaceSection(&end, count, sizeof(Collider));
+	header.bounds = PlaceSection(&end, count, sizeof(BoundingBox));
+	header.filters = PlaceSection(&end, count, sizeof(ColliderFilter));
+	header.flags = PlaceSection(&end, count, sizeof(unsigned int));
+	header.slotHandles = PlaceSection(&end, count, sizeof(ColliderHandle));
+	header.handleSlots = PlaceSection(&end, count, sizeof(int));
+	header.handleGenerations = PlaceSection(&end, count, sizeof(unsigned int));
+	header.gridBuckets = PlaceSection(&end, grid.bucketCount, sizeof(int));
+	header.gridEntries = PlaceSection(&end, grid.capacity, sizeof(HashGridEntry));
+	header.fileSize = end;
+	header.chunkSize = chunkSize;
+	header.cellSize = grid.cellSize;
+	header.occupiedLevels = grid.occupiedLevels;
+	memcpy(header.objectsAtLevel, grid.objectsAtLevel, sizeof(header.objectsAtLevel));
+	memcpy(header.levelHead, grid.levelHead, sizeof(header.levelHead));
+	memcpy(header.maxSizeAtLevel, grid.maxSizeAtLevel, sizeof(header.maxSizeAtLevel));
+
+	FILE* file = fopen(path, "wb");
+	bool ok = file != NULL;
+	ok = ok && fwrite(&header, sizeof(SceneHeader), 1, file) == 1;
+	ok = ok && WriteSection(file, header.shapes, shapes, sizeof(SceneShape));
+	ok = ok && WriteSection(file, header.instances, sorted, sizeof(SceneInstance));
+	ok = ok && WriteSection(file, header.layers, layers, sizeof(SceneLayer));
+	ok = ok && WriteSection(file, header.chunks, chunks, sizeof(SceneChunk));
+	ok = ok && WriteSection(file, header.colliders, colliders, sizeof(Collider));
+	ok = ok && WriteSection(file, header.bounds, bounds, sizeof(BoundingBox));
+	ok = ok && WriteSection(file, header.filters, filters, sizeof(ColliderFilter));
+	ok = ok && WriteSection(file, header.flags, zeros, sizeof(unsigned int));
+	ok = ok && WriteSection(file, header.slotHandles, identity, sizeof(ColliderHandle));
+	ok = ok && WriteSection(file, header.handleSlots, identity, sizeof(int));
+	ok = ok && WriteSection(file, header.handleGenerations, zeros, sizeof(unsigned int));
+	ok = ok && WriteSection(file, header.gridBuckets, grid.buckets, sizeof(int));
+	ok = ok && WriteSection(file, header.gridEntries, grid.entries, sizeof(HashGridEntry));
+	if (file && fclose(file) != 0) ok = false;
+
+	free(keys);
+	free(sorted);
+	free(chunks);
+	free(colliders);
+	free(bounds);
+	free(filters);
+	free(zeros);
+	free(identity);
+	FreeHashGrid(&grid);
+	return ok;
+}
+
+//*******************************************************************
+// Loading
+//*******************************************************************
+
+static bool IsSectionValid(const SceneHeader* header, SceneSection section, size_t size) {
+	if (section.offset % SCENE_ALIGNMENT != 0 || section.offset > header->fileSize) return false;
+	return section.count <= (header->fileSize - section.offset) / size;
+}
+
+static bool IsHeaderValid(const SceneHeader* header, size_t size) {
+	if (memcmp(header->magic, SCENE_MAGIC, 4) != 0 || header->version != SCENE_VERSION) return false;
+	if (header->colliderSize != sizeof(Collider) || header->gridEntrySize != sizeof(HashGridEntry)) return false;
+	if (header->fileSize > size) return false;
+
+	unsigned long long count = header->colliders.count;
+	if (count > COLLIDER_HANDLE_MAX_INDEX + 1ull) return false;
+	if (header->bounds.count != count || header->filters.count != count || header->flags.count != count
+		|| header->slotHandles.count != count || header->handleSlots.count != count
+		|| header->handleGenerations.count != count || header->instances.count != count) return false;
+
+	// Chunks must tile the instances in order
+	const SceneChunk* chunks = (const SceneChunk*) ((const char*) header + header->chunks.offset);
+	if (!IsSectionValid(header, header->chunks, sizeof(SceneChunk))) return false;
+	unsigned long long next = 0;
+	for (unsigned long long i = 0; i < header->chunks.count; i++) {
+		if (chunks[i].first != next || chunks[i].count > count - next) return false;
+		next += chunks[i].count;
+	}
+	if (next != count) return false;
+
+	// Bucket count must be a power of two for the hash mask
+	unsigned long long buckets = header->gridBuckets.count;
+	if (buckets == 0 || (buckets & (buckets - 1)) != 0 || header->gridEntries.count < count) return false;
+
+	return IsSectionValid(header, header->shapes, sizeof(SceneShape))
+		&& IsSectionValid(header, header->instances, sizeof(SceneInstance))
+		&& IsSectionValid(header, header->layers, sizeof(SceneLayer))
+		&& IsSectionValid(header, header->colliders, sizeof(Collider))
+		&& IsSectionValid(header, header->bounds, sizeof(BoundingBox))
+		&& IsSectionValid(header, header->filters, sizeof(ColliderFilter))
+		&& IsSectionValid(header, header->flags, sizeof(unsigned int))
+		&& IsSectionValid(header, header->slotHandles, sizeof(ColliderHandle))
+		&& IsSectionValid(header, header->handleSlots, sizeof(int))
+		&& IsSectionValid(header, header->handleGenerations, sizeof(unsigned int))
+		&& IsSectionValid(header, header->gridBuckets, sizeof(int))
+		&& IsSectionValid(header, header->gridEntries, sizeof(HashGridEntry));
+}
+
+// Pointer fixup is the whole load: every array is used where it lies
+#define SECTION(data, section) ((void*) ((char*) (data) + (section).offset))
+
+static bool IsLinkValid(int id, int count) {
+	return id >= -1 && id < count;
+}
+
+// The view trusts every index it reads, so a damaged file must fail
+// here rather than send a query out of bounds. Walking each list and
+// checking the back link also rules out cycles.
+static bool IsSceneDataValid(const SceneHeader* header, const void* data) {
+	int count = (int) header->colliders.count;
+	const SceneInstance* instances = SECTION(data, header->instances);
+	for (int i = 0; i < count; i++) {
+		if (instances[i].shape >= header->shapes.count || instances[i].layer >= header->layers.count) return false;
+	}
+
+	const ColliderHandle* slotHandle = SECTION(data, header->slotHandles);
+	const int* handleSlot = SECTION(data, header->handleSlots);
+	for (int i = 0; i < count; i++) {
+		if (handleSlot[i] < 0 || handleSlot[i] >= count) return false;
+		if ((slotHandle[handleSlot[i]] & COLLIDER_HANDLE_INDEX_MASK) != (unsigned int) i) return false;
+	}
+
+	if (!(header->cellSize > 0.f) || !isfinite(header->cellSize)) return false;
+	const int* buckets = SECTION(data, header->gridBuckets);
+	const HashGridEntry* entries = SECTION(data, header->gridEntries);
+	int bucketCount = (int) header->gridBuckets.count;
+	int entryCount = (int) header->gridEntries.count;
+
+	int live = 0;
+	unsigned int occupied = 0;
+	for (int id = 0; id < entryCount; id++) {
+		const HashGridEntry* e = &entries[id];
+		if (e->level == -1) continue;
+		if (id >= count || e->level < 0 || e->level >= HGRID_MAX_LEVELS) return false;
+		if (e->bucket < 0 || e->bucket >= bucketCount) return false;
+		if (!IsLinkValid(e->next, entryCount) || !IsLinkValid(e->prev, entryCount)) return false;
+		if (!IsLinkValid(e->levelNext, entryCount) || !IsLinkValid(e->levelPrev, entryCount)) return false;
+		live++;
+	}
+
+	// Every live entry must sit in exactly the bucket it names
+	int linked = 0;
+	for (int b = 0; b < bucketCount; b++) {
+		if (!IsLinkValid(buckets[b], entryCount)) return false;
+		for (int id = buckets[b], prev = -1; id != -1; prev = id, id = entries[id].next) {
+			if (entries[id].level == -1 || entries[id].bucket != b || entries[id].prev != prev) return false;
+			linked++;
+		}
+	}
+	if (linked != live) return false;
+
+	linked = 0;
+	for (int level = 0; level < HGRID_MAX_LEVELS; level++) {
+		if (!IsLinkValid(header->levelHead[level], entryCount)) return false;
+		if (!isfinite(header->maxSizeAtLevel[level])) return false;
+		int atLevel = 0;
+		for (int id = header->levelHead[level], prev = -1; id != -1; prev = id, id = entries[id].levelNext) {
+			if (entries[id].level != level || entries[id].levelPrev != prev) return false;
+			atLevel++;
+		}
+		if (atLevel != header->objectsAtLevel[level]) return false;
+		if (atLevel > 0) occupied |= 1u << level;
+		linked += atLevel;
+	}
+	return linked == live && occupied == header->occupiedLevels;
+}
+
+ColliderScene* LoadColliderScene(const char* path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SceneHeader)) {
+		close(fd);
+		return NULL;
+	}
+	size_t size = (size_t) st.st_size;
+	void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return NULL;
+
+	const SceneHeader* header = data;
+	if (!IsHeaderValid(header, size) || !IsSceneDataValid(header, data)) {
+		munmap(data, size);
+		return NULL;
+	}
+
+	ColliderScene* scene = calloc(1, sizeof(ColliderScene));
+	scene->data = data;
+	scene->size = size;
+	scene->header = header;
+	scene->shapes = SECTION(data, header->shapes);
+	scene->shapeCount = (int) header->shapes.count;
+	scene->instances = SECTION(data, header->instances);
+	scene->instanceCount = (int) header->instances.count;
+	scene->layers = SECTION(data, header->layers);
+	scene->layerCount = (int) header->layers.count;
+	scene->chunks = SECTION(data, header->chunks);
+	scene->chunkCount = (int) header->chunks.count;
+
+	ColliderWorld* world = &scene->world;
+	world->colliders = SECTION(data, header->colliders);
+	world->bounds = SECTION(data, header->bounds);
+	world->filters = SECTION(data, header->filters);
+	world->flags = SECTION(data, header->flags);
+	world->slotHandle = SECTION(data, header->slotHandles);
+	world->count = world->capacity = (int) header->colliders.count;
+	world->handleSlot = SECTION(data, header->handleSlots);
+	world->handleGeneration = SECTION(data, header->handleGenerations);
+	world->handleCount = world->handleCapacity = world->count;
+	world->freeHandle = -1;
+
+	HashGrid* grid = &world->broadphase;
+	grid->cellSize = header->cellSize;
+	grid->buckets = SECTION(data, header->gridBuckets);
+	grid->bucketCount = grid->bucketCapacity = (int) header->gridBuckets.count;
+	grid->entries = SECTION(data, header->gridEntries);
+	grid->capacity = (int) header->gridEntries.count;
+	grid->occupiedLevels = header->occupiedLevels;
+	memcpy(grid->objectsAtLevel, header->objectsAtLevel, sizeof(grid->objectsAtLevel));
+	memcpy(grid->levelHead, header->levelHead, sizeof(grid->levelHead));
+	memcpy(grid->maxSizeAtLevel, header->maxSizeAtLevel, sizeof(grid->maxSizeAtLevel));
+	return scene;
+}
+
+void UnloadColliderScene(ColliderScene* scene) {
+	if (!scene) return;
+	munmap(scene->data, scene->size);
+	free(scene);
+}
+
+// Prefetching rounds out to whole pages. Eviction rounds in, so pages
+// shared with a neighboring chunk, which may still be loaded, stay.
+static void AdviseChunk(ColliderScene* scene, int chunk, bool evict) {
+	const SceneChunk* c = &scene->chunks[chunk];
+	if (c->count == 0) return;
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	const SceneHeader* header = scene->header;
+	SceneSection sections[3] = { header->colliders, header->bounds, header->filters };
+	size_t sizes[3] = { sizeof(Collider), sizeof(BoundingBox), sizeof(ColliderFilter) };
+	for (int i = 0; i < 3; i++) {
+		size_t begin = sections[i].offset + c->first * sizes[i];
+		size_t end = begin + c->count * sizes[i];
+		if (!evict) {
+			begin = begin / page * page;
+			posix_madvise((char*) scene->data + begin, end - begin, POSIX_MADV_WILLNEED);
+			continue;
+		}
+
+		// Mapping is private and never written, so dropped pages are read
+		// back from the file rather than coming back as zeros
+		begin = (begin + page - 1) / page * page;
+		end = end / page * page;
+		if (end > begin) madvise((char*) scene->data + begin, end - begin, MADV_DONTNEED);
+	}
+}
+
+void PrefetchSceneChunk(ColliderScene* scene, int chunk) {
+	AdviseChunk(scene, chunk, false);
+}
+
+void EvictSceneChunk(ColliderScene* scene, int chunk) {
+	AdviseChunk(scene, chunk, true);
+}
+
+void AddSceneToWorld(ColliderWorld* world, ColliderScene* scene, ColliderHandle* handles) {
+	for (int i = 0; i < scene->world.count; i++) {
+		ColliderHandle handle = AddWorldCollider(world, scene->world.colliders[i]);
+		SetWorldColliderFilter(world, handle, scene->world.filters[i]);
+		if (handles) handles[i] = handle;
+	}
+}
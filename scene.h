@@ -0,0 +1,133 @@
+// 
+// Binary scene files loaded by memory mapping
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "world.h"
+
+#define SCENE_MAGIC "OBBS"
+#define SCENE_VERSION 3
+
+// Every section starts on this boundary from the start of the file
+#define SCENE_ALIGNMENT 64
+
+// Box in the local space of its instances
+typedef struct SceneShape {
+	Vector3 min;
+	Vector3 max;
+} SceneShape;
+
+typedef struct SceneInstance {
+	unsigned int shape;
+	unsigned int layer;
+	Vector3 position;
+	Quaternion rotation;
+} SceneInstance;
+
+// Named collision filter shared by instances
+typedef struct SceneLayer {
+	char name[32];
+	ColliderFilter filter;
+} SceneLayer;
+
+// Region of the scene that streams in and out as a unit. Instances are
+// stored grouped by chunk, so each chunk is a contiguous range.
+typedef struct SceneChunk {
+	BoundingBox bounds;
+	unsigned int first;
+	unsigned int count;
+} SceneChunk;
+
+// Byte offset from the start of the file and element count
+typedef struct SceneSection {
+	unsigned long long offset;
+	unsigned long long count;
+} SceneSection;
+
+// Files are written in the byte order and struct layout of the machine
+// that wrote them. The element sizes let a mismatched build reject the
+// file instead of misreading it.
+typedef struct SceneHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int colliderSize;
+	unsigned int gridEntrySize;
+	unsigned long long fileSize;
+
+	// Authoring data
+	SceneSection shapes;
+	SceneSection instances;
+	SceneSection layers;
+	SceneSection chunks;
+	float chunkSize;
+
+	// One entry per instance, laid out exactly as a world stores them
+	SceneSection colliders;
+	SceneSection bounds;
+	SceneSection filters;
+	SceneSection flags;
+	SceneSection slotHandles;
+	SceneSection handleSlots;
+	SceneSection handleGenerations;
+
+	// Prebuilt broadphase, its lists are linked by index so it needs no fixup
+	SceneSection gridBuckets;
+	SceneSection gridEntries;
+	float cellSize;
+	unsigned int occupiedLevels;
+	int objectsAtLevel[HGRID_MAX_LEVELS];
+	int levelHead[HGRID_MAX_LEVELS];
+	float maxSizeAtLevel[HGRID_MAX_LEVELS];
+} SceneHeader;
+
+// A mapped scene file. The world is a read only view into the mapping
+// that works with the query functions and PeekWorldCollider, handles are
+// instance indices. It must never be stepped or modified.
+typedef struct ColliderScene {
+	void* data;
+	size_t size;
+	const SceneHeader* header;
+
+	const SceneShape* shapes;
+	int shapeCount;
+	const SceneInstance* instances;
+	int instanceCount;
+	const SceneLayer* layers;
+	int layerCount;
+	const SceneChunk* chunks;
+	int chunkCount;
+
+	ColliderWorld world;
+} ColliderScene;
+
+// Bakes colliders and the broadphase, then writes the file. Instances
+// are split into cubic chunks of the given size, or kept in one chunk if
+// it is zero, and stored in chunk order rather than the order given.
+bool SaveColliderScene(const char* path, float cellSize, float chunkSize, const SceneShape* shapes, int shapeCount,
+	const SceneInstance* instances, int instanceCount, const SceneLayer* layers, int layerCount);
+
+// Maps the file and points the view at it, NULL if the file is missing,
+// truncated, from an incompatible version or build, or has an index
+// out of range
+ColliderScene* LoadColliderScene(const char* path);
+
+void UnloadColliderScene(ColliderScene* scene);
+
+// Hint that a chunk's colliders will be read soon, so the pages are read
+// ahead instead of faulted in during the step that adds them
+void PrefetchSceneChunk(ColliderScene* scene, int chunk);
+
+// Release the pages holding only this chunk's colliders, they are read
+// back from the file if the chunk is needed again. Chunks smaller than a
+// page share all of theirs with neighbors and keep them.
+void EvictSceneChunk(ColliderScene* scene, int chunk);
+
+// Copy every instance into a world that can be simulated, handles are
+// written in instance order if the array is not NULL
+void AddSceneToWorld(ColliderWorld* world, ColliderScene* scene, ColliderHandle* handles);
+
+#endif
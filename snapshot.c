@@ -0,0 +1,126 @@
+// 
+// Double buffered copies of a world for queries from other threads
+//
+// 2023, Jonathan Tainer
+//
+
+#include "snapshot.h"
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// Each view is a world holding only what queries read
+struct ColliderSnapshots {
+	ColliderWorld views[2];
+	atomic_int readers[2];
+	atomic_int front;
+};
+
+// Grows dst to src's capacity if needed and copies the live part
+static void* CopyArray(ColliderAllocator* allocator, void* dst, const void* src, size_t size, int count, int capacity, bool grow) {
+	if (grow) dst = AllocatorRealloc(allocator, dst, size * capacity);
+	if (count > 0) memcpy(dst, src, size * count);
+	return dst;
+}
+
+static void CopyQueryState(ColliderWorld* dst, ColliderWorld* src) {
+	ColliderAllocator* allocator = &dst->allocator;
+	bool grow = dst->capacity < src->count;
+	dst->colliders = CopyArray(allocator, dst->colliders, src->colliders, sizeof(Collider), src->count, src->capacity, grow);
+	dst->bounds = CopyArray(allocator, dst->bounds, src->bounds, sizeof(BoundingBox), src->count, src->capacity, grow);
+	dst->filters = CopyArray(allocator, dst->filters, src->filters, sizeof(ColliderFilter), src->count, src->capacity, grow);
+	dst->flags = CopyArray(allocator, dst->flags, src->flags, sizeof(unsigned int), src->count, src->capacity, grow);
+	dst->slotHandle = CopyArray(allocator, dst->slotHandle, src->slotHandle, sizeof(ColliderHandle), src->count, src->capacity, grow);
+	if (grow) dst->capacity = src->capacity;
+	dst->count = src->count;
+
+	grow = dst->handleCapacity < src->handleCount;
+	dst->handleSlot = CopyArray(allocator, dst->handleSlot, src->handleSlot,
+		sizeof(int), src->handleCount, src->handleCapacity, grow);
+	dst->handleGeneration = CopyArray(allocator, dst->handleGeneration, src->handleGeneration,
+		sizeof(unsigned int), src->handleCount, src->handleCapacity, grow);
+	if (grow) dst->handleCapacity = src->handleCapacity;
+	dst->handleCount = src->handleCount;
+
+	CopyHashGrid(&dst->broadphase, &src->broadphase);
+}
+
+static void FreeView(ColliderWorld* view) {
+	AllocatorFree(&view->allocator, view->colliders);
+	AllocatorFree(&view->allocator, view->bounds);
+	AllocatorFree(&view->allocator, view->filters);
+	AllocatorFree(&view->allocator, view->flags);
+	AllocatorFree(&view->allocator, view->slotHandle);
+	AllocatorFree(&view->allocator, view->handleSlot);
+	AllocatorFree(&view->allocator, view->handleGeneration);
+	FreeHashGrid(&view->broadphase);
+}
+
+void EnableWorldSnapshots(ColliderWorld* world) {
+	if (world->snapshots) return;
+	ColliderSnapshots* snapshots = AllocatorMalloc(&world->allocator, sizeof(ColliderSnapshots));
+	for (int i = 0; i < 2; i++) {
+		snapshots->views[i] = (ColliderWorld) { 0 };
+		snapshots->views[i].allocator = world->allocator;
+		snapshots->views[i].broadphase = CreateHashGridEx(world->broadphase.cellSize, 1, world->allocator);
+		atomic_init(&snapshots->readers[i], 0);
+	}
+	atomic_init(&snapshots->front, 1);
+	world->snapshots = snapshots;
+	PublishWorldSnapshot(world);
+}
+
+void FreeWorldSnapshots(ColliderWorld* world) {
+	ColliderSnapshots* snapshots = world->snapshots;
+	if (!snapshots) return;
+	for (int i = 0; i < 2; i++) FreeView(&snapshots->views[i]);
+	AllocatorFree(&world->allocator, snapshots);
+	world->snapshots = NULL;
+}
+
+void PublishWorldSnapshot(ColliderWorld* world) {
+	ColliderSnapshots* snapshots = world->snapshots;
+	if (!snapshots) return;
+	int back = 1 - atomic_load(&snapshots->front);
+
+	// New readers only take the front, so this count can only go down.
+	// A reader that loaded the old front index just before it changed
+	// may bump it briefly, but backs off once it sees the new front.
+	while (atomic_load(&snapshots->readers[back]) > 0) sched_yield();
+
+	CopyQueryState(&snapshots->views[back], world);
+	atomic_store(&snapshots->front, back);
+}
+
+ColliderWorld* AcquireWorldSnapshot(ColliderWorld* world) {
+	ColliderSnapshots* snapshots = world->snapshots;
+	if (!snapshots) return NULL;
+
+	// Register on a buffer, then check it is still the front. If it is,
+	// the writer cannot start on it until this reader releases it.
+	for (;;) {
+		int front = atomic_load(&snapshots->front);
+		atomic_fetch_add(&snapshots->readers[front], 1);
+		if (atomic_load(&snapshots->front) == front) return &snapshots->views[front];
+		atomic_fetch_sub(&snapshots->readers[front], 1);
+	}
+}
+
+void ReleaseWorldSnapshot(ColliderWorld* world, ColliderWorld* snapshot) {
+	ColliderSnapshots* snapshots = world->snapshots;
+	atomic_fetch_sub(&snapshots->readers[snapshot - snapshots->views], 1);
+}
+
+size_t GetWorldSnapshotBytes(ColliderWorld* world) {
+	ColliderSnapshots* snapshots = world->snapshots;
+	if (!snapshots) return 0;
+	size_t bytes = sizeof(ColliderSnapshots);
+	for (int i = 0; i < 2; i++) {
+		ColliderWorld* view = &snapshots->views[i];
+		bytes += (sizeof(Collider) + sizeof(BoundingBox) + sizeof(ColliderFilter) + sizeof(unsigned int)
+			+ sizeof(ColliderHandle)) * view->capacity;
+		bytes += (sizeof(int) + sizeof(unsigned int)) * view->handleCapacity;
+		bytes += sizeof(int) * view->broadphase.bucketCapacity + sizeof(HashGridEntry) * view->broadphase.capacity;
+	}
+	return bytes;
+}
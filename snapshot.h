@@ -0,0 +1,38 @@
+// 
+// Double buffered copies of a world for queries from other threads
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "world.h"
+
+// Two copies of the colliders, handle table and broadphase. The step
+// fills the one nobody is reading and then publishes it, so queries on
+// other threads always see a complete state and never block.
+typedef struct ColliderSnapshots ColliderSnapshots;
+
+// Start publishing a snapshot at the end of every step, beginning with
+// the current state
+void EnableWorldSnapshots(ColliderWorld* world);
+
+void FreeWorldSnapshots(ColliderWorld* world);
+
+// Copy the world into the back buffer and make it the front. Waits for
+// readers still holding the back buffer from two steps ago.
+void PublishWorldSnapshot(ColliderWorld* world);
+
+// Latest published state, safe to use from any thread with the query
+// functions and PeekWorldCollider until released. It is read only, and
+// the step after next waits for it, so release it promptly. NULL if
+// snapshots are not enabled.
+ColliderWorld* AcquireWorldSnapshot(ColliderWorld* world);
+
+void ReleaseWorldSnapshot(ColliderWorld* world, ColliderWorld* snapshot);
+
+// Heap memory held by both buffers
+size_t GetWorldSnapshotBytes(ColliderWorld* world);
+
+#endif
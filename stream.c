@@ -0,0 +1,148 @@
+// 
+// Streaming scene chunks in and out of a world around a moving focus
+//
+// 2023, Jonathan Tainer
+//
+
+#include "stream.h"
+#include <raymath.h>
+
+static float GetBoxDistance(BoundingBox box, Vector3 point) {
+	Vector3 nearest = Vector3Clamp(point, box.min, box.max);
+	return Vector3Distance(point, nearest);
+}
+
+ColliderStreamer CreateColliderStreamer(ColliderScene* scene, ColliderWorld* world, float loadRadius, float unloadRadius, int budget) {
+	ColliderStreamer streamer = { 0 };
+	streamer.scene = scene;
+	streamer.world = world;
+	streamer.loadRadius = loadRadius;
+	streamer.unloadRadius = fmaxf(loadRadius, unloadRadius);
+	streamer.budget = budget < 1 ? 1 : budget;
+	streamer.allocator = world->allocator;
+
+	int chunkCount = scene->chunkCount ? scene->chunkCount : 1;
+	int instanceCount = scene->instanceCount ? scene->instanceCount : 1;
+	streamer.states = AllocatorMalloc(&streamer.allocator, sizeof(SceneChunkState) * chunkCount);
+	streamer.resident = AllocatorMalloc(&streamer.allocator, sizeof(unsigned int) * chunkCount);
+	streamer.pending = AllocatorMalloc(&streamer.allocator, sizeof(int) * chunkCount);
+	streamer.handles = AllocatorMalloc(&streamer.allocator, sizeof(ColliderHandle) * instanceCount);
+	for (int i = 0; i < scene->chunkCount; i++) {
+		streamer.states[i] = CHUNK_UNLOADED;
+		streamer.resident[i] = 0;
+	}
+	for (int i = 0; i < scene->instanceCount; i++) streamer.handles[i] = COLLIDER_HANDLE_INVALID;
+	return streamer;
+}
+
+void FreeColliderStreamer(ColliderStreamer* streamer) {
+	AllocatorFree(&streamer->allocator, streamer->states);
+	AllocatorFree(&streamer->allocator, streamer->resident);
+	AllocatorFree(&streamer->allocator, streamer->pending);
+	AllocatorFree(&streamer->allocator, streamer->handles);
+	*streamer = (ColliderStreamer) { 0 };
+}
+
+// Returns false once the world has no free handles left
+static bool AddChunkCollider(ColliderStreamer* streamer, int chunk) {
+	ColliderScene* scene = streamer->scene;
+	unsigned int i = scene->chunks[chunk].first + streamer->resident[chunk];
+
+	// Scenes are in application coordinates, the world may be rebased
+	Collider col = scene->world.colliders[i];
+	ColliderOrigin origin = streamer->world->origin;
+	if (origin.x != 0.0 || origin.y != 0.0 || origin.z != 0.0) {
+		Matrix transform = GetColliderTransform(&col);
+		transform.m12 = (float) (transform.m12 - origin.x);
+		transform.m13 = (float) (transform.m13 - origin.y);
+		transform.m14 = (float) (transform.m14 - origin.z);
+		SetColliderTransform(&col, transform);
+	}
+	ColliderHandle handle = AddWorldCollider(streamer->world, col);
+	if (handle == COLLIDER_HANDLE_INVALID) return false;
+	SetWorldColliderFilter(streamer->world, handle, scene->world.filters[i]);
+	streamer->handles[i] = handle;
+	streamer->resident[chunk]++;
+	return true;
+}
+
+// Newest first, so the resident colliders stay at the front of the range
+static void RemoveChunkCollider(ColliderStreamer* streamer, int chunk) {
+	unsigned int i = streamer->scene->chunks[chunk].first + --streamer->resident[chunk];
+	RemoveWorldCollider(streamer->world, streamer->handles[i]);
+	streamer->handles[i] = COLLIDER_HANDLE_INVALID;
+}
+
+// Insertion sort by distance, the pending list is short and mostly
+// in the same order as last frame
+static void SortPending(ColliderStreamer* streamer, int count, Vector3 focus) {
+	int* pending = streamer->pending;
+	for (int i = 1; i < count; i++) {
+		int chunk = pending[i];
+		float dist = GetBoxDistance(streamer->scene->chunks[chunk].bounds, focus);
+		int j = i - 1;
+		while (j >= 0 && GetBoxDistance(streamer->scene->chunks[pending[j]].bounds, focus) > dist) {
+			pending[j + 1] = pending[j];
+			j--;
+		}
+		pending[j + 1] = chunk;
+	}
+}
+
+int UpdateColliderStreamer(ColliderStreamer* streamer, Vector3 focus) {
+	ColliderScene* scene = streamer->scene;
+	ColliderOrigin origin = streamer->world->origin;
+	focus = (Vector3) { (float) (focus.x + origin.x), (float) (focus.y + origin.y), (float) (focus.z + origin.z) };
+
+	// Pick a direction for every chunk whose distance crossed a radius
+	int pendingCount = 0;
+	for (int chunk = 0; chunk < scene->chunkCount; chunk++) {
+		float dist = GetBoxDistance(scene->chunks[chunk].bounds, focus);
+		SceneChunkState state = streamer->states[chunk];
+		if ((state == CHUNK_UNLOADED || state == CHUNK_UNLOADING) && dist <= streamer->loadRadius) {
+			if (state == CHUNK_UNLOADED) PrefetchSceneChunk(scene, chunk);
+			state = CHUNK_LOADING;
+		}
+		else if ((state == CHUNK_LOADED || state == CHUNK_LOADING) && dist > streamer->unloadRadius) {
+			state = CHUNK_UNLOADING;
+		}
+		streamer->states[chunk] = state;
+		if (state == CHUNK_LOADING || state == CHUNK_UNLOADING) streamer->pending[pendingCount++] = chunk;
+	}
+	SortPending(streamer, pendingCount, focus);
+
+	// Unloading first frees handles and memory for the chunks coming in
+	int budget = streamer->budget;
+	for (int i = pendingCount - 1; i >= 0 && budget > 0; i--) {
+		int chunk = streamer->pending[i];
+		if (streamer->states[chunk] != CHUNK_UNLOADING) continue;
+		while (streamer->resident[chunk] > 0 && budget > 0) {
+			RemoveChunkCollider(streamer, chunk);
+			budget--;
+		}
+		if (streamer->resident[chunk] == 0) {
+			streamer->states[chunk] = CHUNK_UNLOADED;
+			EvictSceneChunk(scene, chunk);
+		}
+	}
+
+	// Nearest chunks load first
+	for (int i = 0; i < pendingCount && budget > 0; i++) {
+		int chunk = streamer->pending[i];
+		if (streamer->states[chunk] != CHUNK_LOADING) continue;
+		while (streamer->resident[chunk] < scene->chunks[chunk].count && budget > 0) {
+			if (!AddChunkCollider(streamer, chunk)) return streamer->budget - budget;
+			budget--;
+		}
+		if (streamer->resident[chunk] == scene->chunks[chunk].count) streamer->states[chunk] = CHUNK_LOADED;
+	}
+	return streamer->budget - budget;
+}
+
+bool IsColliderStreamerIdle(ColliderStreamer* streamer) {
+	for (int chunk = 0; chunk < streamer->scene->chunkCount; chunk++) {
+		SceneChunkState state = streamer->states[chunk];
+		if (state == CHUNK_LOADING || state == CHUNK_UNLOADING) return false;
+	}
+	return true;
+}
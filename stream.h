@@ -0,0 +1,65 @@
+// 
+// Streaming scene chunks in and out of a world around a moving focus
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "scene.h"
+
+typedef enum SceneChunkState {
+	CHUNK_UNLOADED,
+	CHUNK_LOADING,
+	CHUNK_LOADED,
+	CHUNK_UNLOADING,
+} SceneChunkState;
+
+// Pages chunks of a mapped scene into a world as the focus moves. Chunks
+// are added and removed a few colliders at a time, so crossing into a
+// dense region spreads its cost over several frames instead of one.
+// Layer filters decide whether streamed colliders collide with each
+// other, give static layers a mask without themselves to skip those pairs.
+typedef struct ColliderStreamer {
+	ColliderScene* scene;
+	ColliderWorld* world;
+
+	SceneChunkState* states;
+
+	// Colliders of each chunk currently in the world, always the first
+	// ones of its range, so a chunk can turn around halfway through
+	unsigned int* resident;
+
+	// World handle of each scene instance, invalid while not resident
+	ColliderHandle* handles;
+
+	// Chunks closer to the focus first, rebuilt every update
+	int* pending;
+
+	// Chunks start loading once their bounds are within loadRadius of
+	// the focus and start unloading past unloadRadius, which should be
+	// larger so chunks on the boundary do not flicker
+	float loadRadius;
+	float unloadRadius;
+
+	// Colliders added or removed per update at most
+	int budget;
+
+	ColliderAllocator allocator;
+} ColliderStreamer;
+
+ColliderStreamer CreateColliderStreamer(ColliderScene* scene, ColliderWorld* world, float loadRadius, float unloadRadius, int budget);
+
+// Colliders already streamed in stay in the world
+void FreeColliderStreamer(ColliderStreamer* streamer);
+
+// Call once per frame before stepping, with the focus in the world's
+// coordinates, which may be rebased. Returns how many colliders were
+// added or removed.
+int UpdateColliderStreamer(ColliderStreamer* streamer, Vector3 focus);
+
+// True once no chunk is loading or unloading
+bool IsColliderStreamerIdle(ColliderStreamer* streamer);
+
+#endif
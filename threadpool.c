@@ -0,0 +1,134 @@
+// 
+// Minimal thread pool for parallel loops
+//
+// 2023, Jonathan Tainer
+//
+
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+struct ThreadPool {
+	pthread_t* workers;
+	int threadCount;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+
+	// Current job, workers start on it when the generation changes
+	ThreadPoolFunc func;
+	void* user;
+	int count;
+	int grain;
+	atomic_int next;
+	int generation;
+	int active;
+	bool quit;
+};
+
+typedef struct WorkerArgs {
+	ThreadPool* pool;
+	int thread;
+} WorkerArgs;
+
+// Claim chunks until the job runs out
+static void RunChunks(ThreadPool* pool, int thread) {
+	for (;;) {
+		int begin = atomic_fetch_add(&pool->next, pool->grain);
+		if (begin >= pool->count) return;
+		int end = begin + pool->grain < pool->count ? begin + pool->grain : pool->count;
+		pool->func(begin, end, thread, pool->user);
+	}
+}
+
+static void* WorkerMain(void* arg) {
+	WorkerArgs args = *(WorkerArgs*) arg;
+	free(arg);
+	ThreadPool* pool = args.pool;
+
+	int seen = 0;
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (pool->generation == seen && !pool->quit) pthread_cond_wait(&pool->wake, &pool->mutex);
+		if (pool->quit) break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->mutex);
+
+		RunChunks(pool, args.thread);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (--pool->active == 0) pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+ThreadPool* CreateThreadPool(int threadCount) {
+	ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+	pool->threadCount = threadCount < 1 ? 1 : threadCount;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	atomic_init(&pool->next, 0);
+
+	pool->workers = malloc(sizeof(pthread_t) * pool->threadCount);
+	for (int i = 1; i < pool->threadCount; i++) {
+		WorkerArgs* args = malloc(sizeof(WorkerArgs));
+		*args = (WorkerArgs) { pool, i };
+		pthread_create(&pool->workers[i], NULL, WorkerMain, args);
+	}
+	return pool;
+}
+
+void FreeThreadPool(ThreadPool* pool) {
+	if (!pool) return;
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->mutex);
+	for (int i = 1; i < pool->threadCount; i++) pthread_join(pool->workers[i], NULL);
+
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->done);
+	free(pool->workers);
+	free(pool);
+}
+
+int GetThreadPoolSize(ThreadPool* pool) {
+	return pool ? pool->threadCount : 1;
+}
+
+void ThreadPoolFor(ThreadPool* pool, int count, int grain, ThreadPoolFunc func, void* user) {
+	if (count <= 0) return;
+	int threads = GetThreadPoolSize(pool);
+
+	// Default to a few chunks per thread so uneven work balances out
+	if (grain <= 0) grain = count / (threads * 4);
+	if (grain < 1) grain = 1;
+
+	if (threads == 1 || count <= grain) {
+		func(0, count, 0, user);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->func = func;
+	pool->user = user;
+	pool->count = count;
+	pool->grain = grain;
+	atomic_store(&pool->next, 0);
+	pool->active = threads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->mutex);
+
+	RunChunks(pool, 0);
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->active > 0) pthread_cond_wait(&pool->done, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+}
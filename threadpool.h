@@ -0,0 +1,29 @@
+// 
+// Minimal thread pool for parallel loops
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Processes the items in [begin, end), thread is 0 for the calling
+// thread and 1 to n-1 for workers, so it can index per-thread data
+typedef void (*ThreadPoolFunc)(int begin, int end, int thread, void* user);
+
+typedef struct ThreadPool ThreadPool;
+
+// Thread count includes the caller, so 1 creates no workers
+ThreadPool* CreateThreadPool(int threadCount);
+
+void FreeThreadPool(ThreadPool* pool);
+
+// Number of threads including the caller, 1 for a NULL pool
+int GetThreadPoolSize(ThreadPool* pool);
+
+// Split [0, count) into chunks of 'grain' items and run them across
+// the pool, returns once all are done. A NULL pool runs everything on
+// the calling thread. Only one thread may issue work at a time.
+void ThreadPoolFor(ThreadPool* pool, int count, int grain, ThreadPoolFunc func, void* user);
+
+#endif
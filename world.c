@@ -0,0 +1,972 @@
+// 
+// Collection of colliders with broadphase and contact generation
+//
+// 2023, Jonathan Tainer
+//
+
+#include "world.h"
+#include "commandqueue.h"
+#include "snapshot.h"
+#include <raymath.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Grows an array to hold at least 'needed' elements, doubling its capacity
+static void* GrowArray(ColliderWorld* world, void* ptr, int* capacity, int needed, size_t size) {
+	if (needed <= *capacity) return ptr;
+	int newCapacity = *capacity ? *capacity : 64;
+	while (newCapacity < needed) newCapacity *= 2;
+	*capacity = newCapacity;
+	world->mallocCount++;
+	return AllocatorRealloc(&world->allocator, ptr, size * newCapacity);
+}
+
+// Grows every per-slot array together
+static void ReserveSlots(ColliderWorld* world, int needed) {
+	if (needed <= world->capacity) return;
+	int capacity = world->capacity ? world->capacity : 64;
+	while (capacity < needed) capacity *= 2;
+	world->colliders = AllocatorRealloc(&world->allocator, world->colliders, sizeof(Collider) * capacity);
+	world->bounds = AllocatorRealloc(&world->allocator, world->bounds, sizeof(BoundingBox) * capacity);
+	world->filters = AllocatorRealloc(&world->allocator, world->filters, sizeof(ColliderFilter) * capacity);
+	world->flags = AllocatorRealloc(&world->allocator, world->flags, sizeof(unsigned int) * capacity);
+	world->slotHandle = AllocatorRealloc(&world->allocator, world->slotHandle, sizeof(ColliderHandle) * capacity);
+	world->capacity = capacity;
+	world->mallocCount += 5;
+}
+
+// Grows the handle table, both arrays share one capacity
+static void ReserveHandles(ColliderWorld* world, int needed) {
+	if (needed <= world->handleCapacity) return;
+	int capacity = world->handleCapacity ? world->handleCapacity : 64;
+	while (capacity < needed) capacity *= 2;
+	world->handleSlot = AllocatorRealloc(&world->allocator, world->handleSlot, sizeof(int) * capacity);
+	world->handleGeneration = AllocatorRealloc(&world->allocator, world->handleGeneration, sizeof(unsigned int) * capacity);
+	world->parentHandle = AllocatorRealloc(&world->allocator, world->parentHandle, sizeof(ColliderHandle) * capacity);
+	world->childCount = AllocatorRealloc(&world->allocator, world->childCount, sizeof(int) * capacity);
+	world->localTransform = AllocatorRealloc(&world->allocator, world->localTransform, sizeof(Matrix) * capacity);
+	world->transformDirty = AllocatorRealloc(&world->allocator, world->transformDirty, sizeof(bool) * capacity);
+	world->handleMoved = AllocatorRealloc(&world->allocator, world->handleMoved, sizeof(bool) * capacity);
+	world->handleCapacity = capacity;
+	world->mallocCount += 7;
+}
+
+// Storage slot of a live handle, -1 if it is out of range or stale
+static int GetHandleSlot(ColliderWorld* world, ColliderHandle handle) {
+	unsigned int index = handle & COLLIDER_HANDLE_INDEX_MASK;
+	if (index >= (unsigned int) world->handleCount) return -1;
+	if (world->handleGeneration[index] != handle >> COLLIDER_HANDLE_INDEX_BITS) return -1;
+	return world->handleSlot[index];
+}
+
+// Take an entry from the free list, or append one if it is empty
+static ColliderHandle AllocHandle(ColliderWorld* world, int slot) {
+	int index = world->freeHandle;
+	if (index >= 0) world->freeHandle = world->handleSlot[index];
+	else {
+		if (world->handleCount > (int) COLLIDER_HANDLE_MAX_INDEX) return COLLIDER_HANDLE_INVALID;
+		index = world->handleCount++;
+		ReserveHandles(world, world->handleCount);
+		world->handleGeneration[index] = 0;
+	}
+	world->handleSlot[index] = slot;
+	world->parentHandle[index] = COLLIDER_HANDLE_INVALID;
+	world->childCount[index] = 0;
+	world->transformDirty[index] = false;
+	world->handleMoved[index] = false;
+	return (world->handleGeneration[index] << COLLIDER_HANDLE_INDEX_BITS) | (unsigned int) index;
+}
+
+// Bumping the generation invalidates every copy of the handle
+static void FreeHandle(ColliderWorld* world, ColliderHandle handle) {
+	unsigned int index = handle & COLLIDER_HANDLE_INDEX_MASK;
+
+	// Children of a removed collider are detached when the order is rebuilt
+	ColliderHandle parent = world->parentHandle[index];
+	if (parent != COLLIDER_HANDLE_INVALID || world->childCount[index] > 0) world->hierarchyChanged = true;
+	if (GetHandleSlot(world, parent) >= 0) world->childCount[parent & COLLIDER_HANDLE_INDEX_MASK]--;
+	world->parentHandle[index] = COLLIDER_HANDLE_INVALID;
+
+	unsigned int generation = world->handleGeneration[index] + 1;
+	world->handleGeneration[index] = generation & (0xFFFFFFFFu >> COLLIDER_HANDLE_INDEX_BITS);
+	world->handleSlot[index] = world->freeHandle;
+	world->freeHandle = index;
+}
+
+//*******************************************************************
+// World and collider management
+//*******************************************************************
+
+ColliderWorld* CreateColliderWorld(float cellSize) {
+	return CreateColliderWorldEx(cellSize, (ColliderAllocator) { 0 });
+}
+
+ColliderWorld* CreateColliderWorldEx(float cellSize, ColliderAllocator allocator) {
+	if (!IsAllocatorValid(&allocator)) return NULL;
+	ColliderWorld* world = AllocatorMalloc(&allocator, sizeof(ColliderWorld));
+	*world = (ColliderWorld) { 0 };
+	world->allocator = allocator;
+	world->broadphase = CreateHashGridEx(cellSize, 4096, allocator);
+	world->pairCache = CreatePairCacheEx(1024, allocator);
+	world->scratch = CreateArenaEx(1 << 16, allocator);
+	world->freeHandle = -1;
+	world->reorderInterval = COLLIDER_WORLD_REORDER_INTERVAL;
+	return world;
+}
+
+void FreeColliderWorld(ColliderWorld* world) {
+	ColliderAllocator allocator = world->allocator;
+	AllocatorFree(&allocator, world->colliders);
+	AllocatorFree(&allocator, world->bounds);
+	AllocatorFree(&allocator, world->filters);
+	AllocatorFree(&allocator, world->flags);
+	AllocatorFree(&allocator, world->slotHandle);
+	AllocatorFree(&allocator, world->handleSlot);
+	AllocatorFree(&allocator, world->handleGeneration);
+	AllocatorFree(&allocator, world->parentHandle);
+	AllocatorFree(&allocator, world->childCount);
+	AllocatorFree(&allocator, world->localTransform);
+	AllocatorFree(&allocator, world->transformDirty);
+	AllocatorFree(&allocator, world->handleMoved);
+	AllocatorFree(&allocator, world->movedHandles);
+	AllocatorFree(&allocator, world->hierarchyOrder);
+	AllocatorFree(&allocator, world->triggerPairs);
+	AllocatorFree(&allocator, world->prevTriggerPairs);
+	FreeArena(&world->scratch);
+	for (int i = 0; i < world->threadScratchCount; i++) FreeArena(&world->threadScratch[i]);
+	AllocatorFree(&allocator, world->threadScratch);
+	FreeHashGrid(&world->broadphase);
+	FreePairCache(&world->pairCache);
+	FreeWorldSnapshots(world);
+	AllocatorFree(&allocator, world);
+}
+
+ColliderHandle AddWorldCollider(ColliderWorld* world, Collider col) {
+	int slot = world->count;
+	ColliderHandle handle = AllocHandle(world, slot);
+	if (handle == COLLIDER_HANDLE_INVALID) return handle;
+	ReserveSlots(world, slot + 1);
+
+	world->colliders[slot] = col;
+	world->bounds[slot] = GetColliderBounds(&world->colliders[slot]);
+	world->filters[slot] = COLLIDER_FILTER_DEFAULT;
+	world->flags[slot] = 0;
+	world->slotHandle[slot] = handle;
+	world->count++;
+	HashGridInsert(&world->broadphase, slot, world->bounds[slot]);
+	return handle;
+}
+
+bool RemoveWorldCollider(ColliderWorld* world, ColliderHandle handle) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return false;
+	FreeHandle(world, handle);
+	HashGridRemove(&world->broadphase, slot);
+
+	// Fill the hole with the last collider
+	int last = --world->count;
+	if (slot != last) {
+		world->colliders[slot] = world->colliders[last];
+		world->bounds[slot] = world->bounds[last];
+		world->filters[slot] = world->filters[last];
+		world->flags[slot] = world->flags[last];
+		world->slotHandle[slot] = world->slotHandle[last];
+		world->handleSlot[world->slotHandle[slot] & COLLIDER_HANDLE_INDEX_MASK] = slot;
+		HashGridRemove(&world->broadphase, last);
+		HashGridInsert(&world->broadphase, slot, world->bounds[slot]);
+	}
+	return true;
+}
+
+bool IsWorldColliderValid(ColliderWorld* world, ColliderHandle handle) {
+	return GetHandleSlot(world, handle) >= 0;
+}
+
+Collider* GetWorldCollider(ColliderWorld* world, ColliderHandle handle) {
+	int slot = GetHandleSlot(world, handle);
+	// Snapshots and scene views have no moved list and are never stepped
+	if (slot < 0 || !world->handleMoved) return NULL;
+	unsigned int index = handle & COLLIDER_HANDLE_INDEX_MASK;
+	if (!world->handleMoved[index]) {
+		world->movedHandles = GrowArray(world, world->movedHandles, &world->movedCapacity,
+			world->movedCount + 1, sizeof(ColliderHandle));
+		world->movedHandles[world->movedCount++] = handle;
+		world->handleMoved[index] = true;
+	}
+	return &world->colliders[slot];
+}
+
+Collider* PeekWorldCollider(ColliderWorld* world, ColliderHandle handle) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return NULL;
+	return &world->colliders[slot];
+}
+
+// Bring bounds and the broadphase up to date after a slot's collider moved
+static void RefreshSlot(ColliderWorld* world, int slot) {
+	world->bounds[slot] = GetColliderBounds(&world->colliders[slot]);
+	HashGridUpdate(&world->broadphase, slot, world->bounds[slot]);
+}
+
+// Colliders removed since they were handed out are skipped as stale
+static void RefreshMovedColliders(ColliderWorld* world) {
+	for (int i = 0; i < world->movedCount; i++) {
+		ColliderHandle handle = world->movedHandles[i];
+		world->handleMoved[handle & COLLIDER_HANDLE_INDEX_MASK] = false;
+		int slot = GetHandleSlot(world, handle);
+		if (slot >= 0) RefreshSlot(world, slot);
+	}
+	world->movedCount = 0;
+}
+
+void SetWorldColliderFilter(ColliderWorld* world, ColliderHandle handle, ColliderFilter filter) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return;
+	world->filters[slot] = filter;
+}
+
+ColliderFilter GetWorldColliderFilter(ColliderWorld* world, ColliderHandle handle) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return COLLIDER_FILTER_DEFAULT;
+	return world->filters[slot];
+}
+
+void SetWorldColliderTrigger(ColliderWorld* world, ColliderHandle handle, bool trigger) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return;
+	unsigned int* flags = &world->flags[slot];
+	if (trigger) *flags |= COLLIDER_FLAG_TRIGGER;
+	else *flags &= ~COLLIDER_FLAG_TRIGGER;
+}
+
+//*******************************************************************
+// Batched transforms
+//*******************************************************************
+
+typedef struct TransformBatchContext {
+	ColliderWorld* world;
+	ColliderTransformBatch batch;
+} TransformBatchContext;
+
+#define STRIDED(type, base, stride, i) (*(const type*) ((const char*) (base) + (stride) * (size_t) (i)))
+
+// Only touches the slots of its own range, so ranges run concurrently
+static void RunTransformBatch(int begin, int end, int thread, void* user) {
+	(void) thread;
+	TransformBatchContext* ctx = user;
+	ColliderWorld* world = ctx->world;
+	ColliderTransformBatch* batch = &ctx->batch;
+	for (int i = begin; i < end; i++) {
+		int slot = GetHandleSlot(world, STRIDED(ColliderHandle, batch->handles, batch->handleStride, i));
+		if (slot < 0) continue;
+
+		Collider* col = &world->colliders[slot];
+		unsigned int index = world->slotHandle[slot] & COLLIDER_HANDLE_INDEX_MASK;
+		bool attached = world->parentHandle[index] != COLLIDER_HANDLE_INVALID;
+		Vector3 pos = STRIDED(Vector3, batch->positions, batch->positionStride, i);
+		// Attached colliders store a global rotation, so without rotations
+		// their local one is kept instead of compounding the parent's
+		Matrix transform = batch->rotations
+			? QuaternionToMatrix(STRIDED(Quaternion, batch->rotations, batch->rotationStride, i))
+			: attached ? world->localTransform[index] : col->matRotate;
+		transform.m12 = pos.x;
+		transform.m13 = pos.y;
+		transform.m14 = pos.z;
+
+		// Each handle is in the batch once, so these writes never collide
+		world->transformDirty[index] = true;
+		if (attached) {
+			world->localTransform[index] = transform;
+			continue;
+		}
+		SetColliderTransform(col, transform);
+		world->bounds[slot] = GetColliderBounds(col);
+	}
+}
+
+void SetWorldTransformBatch(ColliderWorld* world, ColliderTransformBatch batch) {
+	if (batch.count <= 0) return;
+	if (batch.handleStride == 0) batch.handleStride = sizeof(ColliderHandle);
+	if (batch.positionStride == 0) batch.positionStride = sizeof(Vector3);
+	if (batch.rotationStride == 0) batch.rotationStride = sizeof(Quaternion);
+
+	TransformBatchContext ctx = { world, batch };
+	ThreadPoolFor(world->pool, batch.count, 256, RunTransformBatch, &ctx);
+
+	// The grid is not thread safe, relinking is cheap next to the transforms
+	for (int i = 0; i < batch.count; i++) {
+		int slot = GetHandleSlot(world, STRIDED(ColliderHandle, batch.handles, batch.handleStride, i));
+		if (slot >= 0) HashGridUpdate(&world->broadphase, slot, world->bounds[slot]);
+	}
+}
+
+//*******************************************************************
+// Floating origin
+//*******************************************************************
+
+typedef struct RebaseContext {
+	ColliderWorld* world;
+	Vector3 shift;
+} RebaseContext;
+
+// Global verts are rebuilt from the shifted transform rather than
+// shifted themselves, so they lose the rounding of the far position
+static void RunRebase(int begin, int end, int thread, void* user) {
+	(void) thread;
+	RebaseContext* ctx = user;
+	ColliderWorld* world = ctx->world;
+	for (int slot = begin; slot < end; slot++) {
+		Collider* col = &world->colliders[slot];
+		Matrix transform = GetColliderTransform(col);
+		transform.m12 -= ctx->shift.x;
+		transform.m13 -= ctx->shift.y;
+		transform.m14 -= ctx->shift.z;
+		SetColliderTransform(col, transform);
+		world->bounds[slot] = GetColliderBounds(col);
+	}
+}
+
+void RebaseColliderWorld(ColliderWorld* world, Vector3 shift) {
+	RebaseContext ctx = { world, shift };
+	ThreadPoolFor(world->pool, world->count, 256, RunRebase, &ctx);
+	world->origin.x += shift.x;
+	world->origin.y += shift.y;
+	world->origin.z += shift.z;
+
+	// Every cell changes, so relinking one by one would touch each bucket twice
+	HashGridClear(&world->broadphase);
+	for (int slot = 0; slot < world->count; slot++) HashGridInsert(&world->broadphase, slot, world->bounds[slot]);
+}
+
+bool RebaseColliderWorldAround(ColliderWorld* world, Vector3 focus, float distance) {
+	if (Vector3Length(focus) <= distance) return false;
+	float cellSize = world->broadphase.cellSize;
+	Vector3 shift = {
+		roundf(focus.x / cellSize) * cellSize,
+		roundf(focus.y / cellSize) * cellSize,
+		roundf(focus.z / cellSize) * cellSize,
+	};
+	RebaseColliderWorld(world, shift);
+	return true;
+}
+
+//*******************************************************************
+// Transform hierarchy
+//*******************************************************************
+
+static unsigned int GetHandleIndex(ColliderHandle handle) {
+	return handle & COLLIDER_HANDLE_INDEX_MASK;
+}
+
+bool SetWorldColliderParent(ColliderWorld* world, ColliderHandle handle, ColliderHandle parent) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return false;
+	unsigned int index = GetHandleIndex(handle);
+
+	Matrix transform = GetColliderTransform(&world->colliders[slot]);
+	if (parent != COLLIDER_HANDLE_INVALID) {
+		int parentSlot = GetHandleSlot(world, parent);
+		if (parentSlot < 0) return false;
+
+		// Walk up from the new parent, reaching the child means a cycle
+		for (ColliderHandle up = parent; GetHandleSlot(world, up) >= 0; up = world->parentHandle[GetHandleIndex(up)]) {
+			if (up == handle) return false;
+		}
+
+		// Local transform that leaves the collider where it is
+		Matrix parentTransform = GetColliderTransform(&world->colliders[parentSlot]);
+		world->localTransform[index] = MatrixMultiply(transform, MatrixInvert(parentTransform));
+	}
+
+	ColliderHandle old = world->parentHandle[index];
+	if (old == parent) return true;
+	if (old != COLLIDER_HANDLE_INVALID && GetHandleSlot(world, old) >= 0) world->childCount[GetHandleIndex(old)]--;
+	if (parent != COLLIDER_HANDLE_INVALID) world->childCount[GetHandleIndex(parent)]++;
+	world->parentHandle[index] = parent;
+	world->transformDirty[index] = true;
+	world->hierarchyChanged = true;
+	return true;
+}
+
+ColliderHandle GetWorldColliderParent(ColliderWorld* world, ColliderHandle handle) {
+	if (GetHandleSlot(world, handle) < 0) return COLLIDER_HANDLE_INVALID;
+	ColliderHandle parent = world->parentHandle[GetHandleIndex(handle)];
+	return GetHandleSlot(world, parent) < 0 ? COLLIDER_HANDLE_INVALID : parent;
+}
+
+void SetWorldColliderTransform(ColliderWorld* world, ColliderHandle handle, Matrix transform) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return;
+	unsigned int index = GetHandleIndex(handle);
+	int parentSlot = GetHandleSlot(world, world->parentHandle[index]);
+	if (parentSlot >= 0) {
+		Matrix parentTransform = GetColliderTransform(&world->colliders[parentSlot]);
+		world->localTransform[index] = MatrixMultiply(transform, MatrixInvert(parentTransform));
+	}
+	SetColliderTransform(&world->colliders[slot], transform);
+	RefreshSlot(world, slot);
+	world->transformDirty[index] = true;
+}
+
+void SetWorldColliderLocalTransform(ColliderWorld* world, ColliderHandle handle, Matrix transform) {
+	int slot = GetHandleSlot(world, handle);
+	if (slot < 0) return;
+	unsigned int index = GetHandleIndex(handle);
+	if (world->parentHandle[index] != COLLIDER_HANDLE_INVALID) world->localTransform[index] = transform;
+	else {
+		SetColliderTransform(&world->colliders[slot], transform);
+		RefreshSlot(world, slot);
+	}
+	world->transformDirty[index] = true;
+}
+
+typedef struct DepthKey {
+	int depth;
+	ColliderHandle handle;
+} DepthKey;
+
+static int CompareDepthKeys(const void* a, const void* b) {
+	const DepthKey* ka = a;
+	const DepthKey* kb = b;
+	if (ka->depth != kb->depth) return ka->depth - kb->depth;
+	unsigned int ia = GetHandleIndex(ka->handle);
+	unsigned int ib = GetHandleIndex(kb->handle);
+	return ia < ib ? -1 : ia > ib;
+}
+
+// Sorting attached colliders by depth puts every parent before its
+// children, so one forward pass can propagate transforms down the tree
+static void SortHierarchy(ColliderWorld* world) {
+	DepthKey* keys = ArenaAlloc(&world->scratch, sizeof(DepthKey) * world->handleCount);
+	int count = 0;
+	for (int i = 0; i < world->handleCount; i++) {
+		ColliderHandle parent = world->parentHandle[i];
+		if (parent == COLLIDER_HANDLE_INVALID) continue;
+
+		// Parent was removed, the child stays where it is as a root
+		if (GetHandleSlot(world, parent) < 0) {
+			world->parentHandle[i] = COLLIDER_HANDLE_INVALID;
+			continue;
+		}
+
+		int depth = 1;
+		for (ColliderHandle up = world->parentHandle[GetHandleIndex(parent)];
+			up != COLLIDER_HANDLE_INVALID && GetHandleSlot(world, up) >= 0;
+			up = world->parentHandle[GetHandleIndex(up)]) depth++;
+		keys[count++] = (DepthKey) { depth, (world->handleGeneration[i] << COLLIDER_HANDLE_INDEX_BITS) | (unsigned int) i };
+	}
+	if (count > 1) qsort(keys, count, sizeof(DepthKey), CompareDepthKeys);
+
+	world->hierarchyOrder = GrowArray(world, world->hierarchyOrder, &world->hierarchyCapacity, count, sizeof(ColliderHandle));
+	for (int i = 0; i < count; i++) world->hierarchyOrder[i] = keys[i].handle;
+	world->hierarchyCount = count;
+	world->hierarchyChanged = false;
+}
+
+void UpdateWorldHierarchy(ColliderWorld* world) {
+	if (world->hierarchyChanged) SortHierarchy(world);
+
+	// A dirty parent has already been placed and marks each child in turn
+	for (int i = 0; i < world->hierarchyCount; i++) {
+		ColliderHandle handle = world->hierarchyOrder[i];
+		unsigned int index = GetHandleIndex(handle);
+		ColliderHandle parent = world->parentHandle[index];
+		if (!world->transformDirty[index] && !world->transformDirty[GetHandleIndex(parent)]) continue;
+
+		int slot = world->handleSlot[index];
+		Matrix parentTransform = GetColliderTransform(&world->colliders[world->handleSlot[GetHandleIndex(parent)]]);
+		SetColliderTransform(&world->colliders[slot], MatrixMultiply(world->localTransform[index], parentTransform));
+		RefreshSlot(world, slot);
+		world->transformDirty[index] = true;
+	}
+	if (world->handleCount > 0) memset(world->transformDirty, 0, sizeof(bool) * world->handleCount);
+}
+
+static size_t GetArenaBytes(Arena* arena) {
+	return arena->capacity + arena->overflowBytes;
+}
+
+// Computed from capacities, which is what is actually held on the heap
+ColliderMemoryReport GetColliderWorldMemory(ColliderWorld* world) {
+	ColliderMemoryReport report = { 0 };
+	size_t shapeSize = sizeof(((Collider*) 0)->vertLocal);
+	report.shapes = shapeSize * world->capacity;
+	report.colliders = (sizeof(Collider) - shapeSize + sizeof(BoundingBox) + sizeof(ColliderFilter)
+		+ sizeof(unsigned int) + sizeof(ColliderHandle)) * world->capacity;
+	report.colliders += (sizeof(int) * 2 + sizeof(unsigned int) + sizeof(ColliderHandle) + sizeof(Matrix) + sizeof(bool) * 2)
+		* world->handleCapacity;
+	report.colliders += sizeof(ColliderHandle) * (world->hierarchyCapacity + world->movedCapacity);
+	report.colliders += sizeof(TriggerPair) * (world->triggerPairCapacity + world->prevTriggerPairCapacity);
+	report.colliders += sizeof(ColliderWorld);
+
+	HashGrid* grid = &world->broadphase;
+	report.broadphase = sizeof(int) * grid->bucketCapacity + sizeof(HashGridEntry) * grid->capacity;
+
+	PairCache* cache = &world->pairCache;
+	report.pairCache = 2 * sizeof(PairCacheEntry) * cache->tableCapacity + sizeof(PairCacheBuffer) * cache->bufferCount;
+
+	report.scratch = GetArenaBytes(&world->scratch) + sizeof(Arena) * world->threadScratchCount;
+	for (int i = 0; i < world->threadScratchCount; i++) report.scratch += GetArenaBytes(&world->threadScratch[i]);
+
+	report.snapshots = GetWorldSnapshotBytes(world);
+	report.commands = GetColliderCommandQueueBytes(world->commands);
+	report.total = report.colliders + report.shapes + report.broadphase + report.pairCache + report.scratch
+		+ report.snapshots + report.commands;
+	return report;
+}
+
+//*******************************************************************
+// State copies
+//*******************************************************************
+
+// Grows dst to src's capacity if needed and copies the live part
+static void* CopySlots(ColliderWorld* dst, void* to, const void* from, size_t size, int count, int capacity, bool grow) {
+	if (grow) {
+		to = AllocatorRealloc(&dst->allocator, to, size * capacity);
+		dst->mallocCount++;
+	}
+	if (count > 0) memcpy(to, from, size * count);
+	return to;
+}
+
+void CopyColliderWorldState(ColliderWorld* dst, ColliderWorld* src) {
+	bool grow = dst->capacity < src->count;
+	dst->colliders = CopySlots(dst, dst->colliders, src->colliders, sizeof(Collider), src->count, src->capacity, grow);
+	dst->bounds = CopySlots(dst, dst->bounds, src->bounds, sizeof(BoundingBox), src->count, src->capacity, grow);
+	dst->filters = CopySlots(dst, dst->filters, src->filters, sizeof(ColliderFilter), src->count, src->capacity, grow);
+	dst->flags = CopySlots(dst, dst->flags, src->flags, sizeof(unsigned int), src->count, src->capacity, grow);
+	dst->slotHandle = CopySlots(dst, dst->slotHandle, src->slotHandle, sizeof(ColliderHandle), src->count, src->capacity, grow);
+	if (grow) dst->capacity = src->capacity;
+	dst->count = src->count;
+
+	int handles = src->handleCount;
+	grow = dst->handleCapacity < handles;
+	dst->handleSlot = CopySlots(dst, dst->handleSlot, src->handleSlot, sizeof(int), handles, src->handleCapacity, grow);
+	dst->handleGeneration = CopySlots(dst, dst->handleGeneration, src->handleGeneration,
+		sizeof(unsigned int), handles, src->handleCapacity, grow);
+	dst->parentHandle = CopySlots(dst, dst->parentHandle, src->parentHandle,
+		sizeof(ColliderHandle), handles, src->handleCapacity, grow);
+	dst->childCount = CopySlots(dst, dst->childCount, src->childCount, sizeof(int), handles, src->handleCapacity, grow);
+	dst->localTransform = CopySlots(dst, dst->localTransform, src->localTransform,
+		sizeof(Matrix), handles, src->handleCapacity, grow);
+	dst->transformDirty = CopySlots(dst, dst->transformDirty, src->transformDirty,
+		sizeof(bool), handles, src->handleCapacity, grow);
+	dst->handleMoved = CopySlots(dst, dst->handleMoved, src->handleMoved, sizeof(bool), handles, src->handleCapacity, grow);
+	if (grow) dst->handleCapacity = src->handleCapacity;
+	dst->handleCount = handles;
+	dst->freeHandle = src->freeHandle;
+
+	grow = dst->hierarchyCapacity < src->hierarchyCount;
+	dst->hierarchyOrder = CopySlots(dst, dst->hierarchyOrder, src->hierarchyOrder,
+		sizeof(ColliderHandle), src->hierarchyCount, src->hierarchyCapacity, grow);
+	if (grow) dst->hierarchyCapacity = src->hierarchyCapacity;
+	dst->hierarchyCount = src->hierarchyCount;
+	dst->hierarchyChanged = src->hierarchyChanged;
+
+	grow = dst->movedCapacity < src->movedCount;
+	dst->movedHandles = CopySlots(dst, dst->movedHandles, src->movedHandles,
+		sizeof(ColliderHandle), src->movedCount, src->movedCapacity, grow);
+	if (grow) dst->movedCapacity = src->movedCapacity;
+	dst->movedCount = src->movedCount;
+
+	grow = dst->triggerPairCapacity < src->triggerPairCount;
+	dst->triggerPairs = CopySlots(dst, dst->triggerPairs, src->triggerPairs,
+		sizeof(TriggerPair), src->triggerPairCount, src->triggerPairCapacity, grow);
+	if (grow) dst->triggerPairCapacity = src->triggerPairCapacity;
+	dst->triggerPairCount = src->triggerPairCount;
+
+	CopyHashGrid(&dst->broadphase, &src->broadphase);
+	CopyPairCache(&dst->pairCache, &src->pairCache);
+	dst->origin = src->origin;
+	dst->stepsSinceReorder = src->stepsSinceReorder;
+}
+
+//*******************************************************************
+// Spatial reordering
+//*******************************************************************
+
+// Spread the low 10 bits of v so there are two zero bits between each
+static unsigned int SpreadBits(unsigned int v) {
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+// 30 bit Morton code of a point normalized to the unit cube
+static unsigned int GetMortonCode(Vector3 p) {
+	unsigned int x = (unsigned int) Clamp(p.x * 1024.f, 0.f, 1023.f);
+	unsigned int y = (unsigned int) Clamp(p.y * 1024.f, 0.f, 1023.f);
+	unsigned int z = (unsigned int) Clamp(p.z * 1024.f, 0.f, 1023.f);
+	return (SpreadBits(x) << 2) | (SpreadBits(y) << 1) | SpreadBits(z);
+}
+
+typedef struct MortonKey {
+	unsigned int code;
+	int slot;
+} MortonKey;
+
+static int CompareMortonKeys(const void* a, const void* b) {
+	const MortonKey* ka = a;
+	const MortonKey* kb = b;
+	if (ka->code != kb->code) return ka->code < kb->code ? -1 : 1;
+	return ka->slot - kb->slot;
+}
+
+// Rearrange a per-slot array into sorted order through a scratch copy
+static void PermuteSlots(Arena* scratch, void* array, size_t size, const MortonKey* keys, int count) {
+	char* copy = ArenaAlloc(scratch, size * count);
+	memcpy(copy, array, size * count);
+	for (int i = 0; i < count; i++) memcpy((char*) array + size * i, copy + size * keys[i].slot, size);
+}
+
+void ReorderColliderWorld(ColliderWorld* world) {
+	int count = world->count;
+	if (count < 2) return;
+
+	// Normalize centers against the bounds of all centers
+	Vector3 lo = Vector3Scale(Vector3Add(world->bounds[0].min, world->bounds[0].max), 0.5f);
+	Vector3 hi = lo;
+	for (int i = 1; i < count; i++) {
+		Vector3 center = Vector3Scale(Vector3Add(world->bounds[i].min, world->bounds[i].max), 0.5f);
+		lo = Vector3Min(lo, center);
+		hi = Vector3Max(hi, center);
+	}
+	Vector3 extent = Vector3Subtract(hi, lo);
+	Vector3 scale = {
+		extent.x > 0.f ? 1.f / extent.x : 0.f,
+		extent.y > 0.f ? 1.f / extent.y : 0.f,
+		extent.z > 0.f ? 1.f / extent.z : 0.f,
+	};
+
+	MortonKey* keys = ArenaAlloc(&world->scratch, sizeof(MortonKey) * count);
+	for (int i = 0; i < count; i++) {
+		Vector3 center = Vector3Scale(Vector3Add(world->bounds[i].min, world->bounds[i].max), 0.5f);
+		keys[i].code = GetMortonCode(Vector3Multiply(Vector3Subtract(center, lo), scale));
+		keys[i].slot = i;
+	}
+	qsort(keys, count, sizeof(MortonKey), CompareMortonKeys);
+
+	// Gather into new arrays in sorted order
+	PermuteSlots(&world->scratch, world->colliders, sizeof(Collider), keys, count);
+	PermuteSlots(&world->scratch, world->bounds, sizeof(BoundingBox), keys, count);
+	PermuteSlots(&world->scratch, world->filters, sizeof(ColliderFilter), keys, count);
+	PermuteSlots(&world->scratch, world->flags, sizeof(unsigned int), keys, count);
+	PermuteSlots(&world->scratch, world->slotHandle, sizeof(ColliderHandle), keys, count);
+	for (int i = 0; i < count; i++) world->handleSlot[world->slotHandle[i] & COLLIDER_HANDLE_INDEX_MASK] = i;
+
+	// Broadphase ids are slots, so it has to be rebuilt
+	HashGridClear(&world->broadphase);
+	for (int i = 0; i < count; i++) HashGridInsert(&world->broadphase, i, world->bounds[i]);
+	world->stepsSinceReorder = 0;
+}
+
+//*******************************************************************
+// Simulation step
+//*******************************************************************
+
+static bool ShouldCollide(ColliderFilter a, ColliderFilter b) {
+	if (a.group != 0 && a.group == b.group) return a.group > 0;
+	return (a.category & b.mask) && (b.category & a.mask);
+}
+
+static void AddPair(int a, int b, void* user) {
+	ColliderWorld* world = user;
+	if (!ShouldCollide(world->filters[a], world->filters[b])) return;
+	if (world->pairCount == world->pairCapacity) {
+		int capacity = world->pairCapacity ? world->pairCapacity * 2 : 256;
+		world->pairs = ArenaRealloc(&world->scratch, world->pairs,
+			sizeof(ColliderPair) * world->pairCapacity, sizeof(ColliderPair) * capacity);
+		world->pairCapacity = capacity;
+	}
+	world->pairs[world->pairCount++] = (ColliderPair) { a < b ? a : b, a < b ? b : a, false, { 0.f, 0.f, 0.f } };
+}
+
+static int ComparePairs(const void* a, const void* b) {
+	const ColliderPair* pa = a;
+	const ColliderPair* pb = b;
+	if (pa->a != pb->a) return pa->a - pb->a;
+	return pa->b - pb->b;
+}
+
+static int CompareTriggerPairs(const void* a, const void* b) {
+	const TriggerPair* pa = a;
+	const TriggerPair* pb = b;
+	if (pa->trigger != pb->trigger) return pa->trigger < pb->trigger ? -1 : 1;
+	if (pa->other != pb->other) return pa->other < pb->other ? -1 : 1;
+	return 0;
+}
+
+// Event buffer is sized for the worst case before the merge
+static void AddTriggerEvent(ColliderWorld* world, TriggerEventType type, TriggerPair pair) {
+	world->triggerEvents[world->triggerEventCount++] = (TriggerEvent) { type, pair.trigger, pair.other };
+}
+
+// Last step's overlaps become the baseline for this one
+static void SwapTriggerPairs(ColliderWorld* world) {
+	TriggerPair* pairs = world->prevTriggerPairs;
+	int capacity = world->prevTriggerPairCapacity;
+	world->prevTriggerPairs = world->triggerPairs;
+	world->prevTriggerPairCount = world->triggerPairCount;
+	world->prevTriggerPairCapacity = world->triggerPairCapacity;
+	world->triggerPairs = pairs;
+	world->triggerPairCapacity = capacity;
+	world->triggerPairCount = 0;
+}
+
+// Merge the sorted overlaps of this step and the last one, pairs only
+// in the new set begin, pairs in both stay and pairs only in the old end
+static void UpdateTriggerEvents(ColliderWorld* world) {
+	if (world->triggerPairCount > 1) qsort(world->triggerPairs, world->triggerPairCount, sizeof(TriggerPair), CompareTriggerPairs);
+
+	world->triggerEvents = ArenaAlloc(&world->scratch,
+		sizeof(TriggerEvent) * (world->triggerPairCount + world->prevTriggerPairCount));
+	world->triggerEventCount = 0;
+	int i = 0, j = 0;
+	while (i < world->triggerPairCount || j < world->prevTriggerPairCount) {
+		int order;
+		if (i == world->triggerPairCount) order = 1;
+		else if (j == world->prevTriggerPairCount) order = -1;
+		else order = CompareTriggerPairs(&world->triggerPairs[i], &world->prevTriggerPairs[j]);
+
+		if (order < 0) AddTriggerEvent(world, TRIGGER_BEGIN, world->triggerPairs[i++]);
+		else if (order > 0) AddTriggerEvent(world, TRIGGER_END, world->prevTriggerPairs[j++]);
+		else {
+			AddTriggerEvent(world, TRIGGER_STAY, world->triggerPairs[i++]);
+			j++;
+		}
+	}
+}
+
+static void RunNarrowphase(int begin, int end, int thread, void* user) {
+	ColliderWorld* world = user;
+	for (int i = begin; i < end; i++) {
+		ColliderPair* pair = &world->pairs[i];
+		Collider* a = &world->colliders[pair->a];
+		Collider* b = &world->colliders[pair->b];
+
+		// Triggers only need to know whether they overlap
+		if ((world->flags[pair->a] | world->flags[pair->b]) & COLLIDER_FLAG_TRIGGER) {
+			pair->touching = TestColliderPair(a, b);
+			pair->correction = Vector3Zero();
+		}
+		else {
+			pair->correction = GetCollisionCorrection(a, b);
+			pair->touching = !Vector3Equals(pair->correction, Vector3Zero());
+		}
+
+		PairCacheEntry* entry = PairCacheTouch(&world->pairCache, thread,
+			world->slotHandle[pair->a], world->slotHandle[pair->b]);
+		entry->correction = pair->correction;
+	}
+}
+
+// Heap allocations made by the world and everything it owns
+static int CountWorldMallocs(ColliderWorld* world) {
+	int count = world->mallocCount + world->broadphase.mallocCount + world->pairCache.mallocCount
+		+ world->scratch.mallocCount;
+	for (int i = 0; i < world->threadScratchCount; i++) count += world->threadScratch[i].mallocCount;
+	return count;
+}
+
+// Release last step's temporaries, making sure each pool thread has an arena
+static void BeginScratch(ColliderWorld* world, ThreadPool* pool) {
+	int threads = GetThreadPoolSize(pool);
+	if (threads > world->threadScratchCount) {
+		world->threadScratch = AllocatorRealloc(&world->allocator, world->threadScratch, sizeof(Arena) * threads);
+		for (int i = world->threadScratchCount; i < threads; i++) {
+			world->threadScratch[i] = CreateArenaEx(1 << 14, world->allocator);
+		}
+		world->threadScratchCount = threads;
+		world->mallocCount++;
+	}
+
+	ResetArena(&world->scratch);
+	for (int i = 0; i < world->threadScratchCount; i++) ResetArena(&world->threadScratch[i]);
+	world->pairs = NULL;
+	world->pairCount = 0;
+	world->pairCapacity = 0;
+}
+
+// Live steps also take commands from other threads, report trigger
+// events and publish snapshots, none of which a replayed step should do
+static void StepWorld(ColliderWorld* world, ThreadPool* pool, bool live) {
+	int mallocsBefore = CountWorldMallocs(world);
+	BeginScratch(world, pool);
+
+	// Every other way of moving a collider keeps its bounds up to date
+	if (live && world->commands) ApplyColliderCommands(world->commands, world);
+	RefreshMovedColliders(world);
+	UpdateWorldHierarchy(world);
+
+	if (world->reorderInterval > 0 && ++world->stepsSinceReorder >= world->reorderInterval) {
+		ReorderColliderWorld(world);
+	}
+
+	// Sorting the pairs makes the narrowphase walk storage in order
+	HashGridFindPairs(&world->broadphase, AddPair, world);
+	if (world->pairCount > 1) qsort(world->pairs, world->pairCount, sizeof(ColliderPair), ComparePairs);
+
+	// Each thread writes only to its own pairs and cache entries
+	BeginPairCacheStep(&world->pairCache, world->threadScratch, GetThreadPoolSize(pool));
+	ThreadPoolFor(pool, world->pairCount, 64, RunNarrowphase, world);
+	EndPairCacheStep(&world->pairCache);
+
+	// Gather results in pair order
+	world->contacts = ArenaAlloc(&world->scratch, sizeof(ColliderContact) * world->pairCount);
+	world->contactCount = 0;
+	SwapTriggerPairs(world);
+	for (int i = 0; i < world->pairCount; i++) {
+		ColliderPair pair = world->pairs[i];
+		if (!pair.touching) continue;
+
+		if ((world->flags[pair.a] | world->flags[pair.b]) & COLLIDER_FLAG_TRIGGER) {
+			// Slot order changes on reorders and removals, so when both are
+			// triggers the smaller handle goes first to match across steps
+			ColliderHandle trigger = world->slotHandle[pair.a];
+			ColliderHandle other = world->slotHandle[pair.b];
+			bool swap = (world->flags[pair.b] & COLLIDER_FLAG_TRIGGER)
+				? other < trigger
+				: !(world->flags[pair.a] & COLLIDER_FLAG_TRIGGER);
+			world->triggerPairs = GrowArray(world, world->triggerPairs, &world->triggerPairCapacity,
+				world->triggerPairCount + 1, sizeof(TriggerPair));
+			world->triggerPairs[world->triggerPairCount++] = swap
+				? (TriggerPair) { other, trigger }
+				: (TriggerPair) { trigger, other };
+			continue;
+		}
+
+		world->contacts[world->contactCount++] = (ColliderContact) {
+			world->slotHandle[pair.a],
+			world->slotHandle[pair.b],
+			pair.correction,
+		};
+	}
+
+	if (live) {
+		UpdateTriggerEvents(world);
+		PublishWorldSnapshot(world);
+	}
+	else {
+		// Overlaps still have to be sorted to serve as the next baseline
+		if (world->triggerPairCount > 1) qsort(world->triggerPairs, world->triggerPairCount, sizeof(TriggerPair), CompareTriggerPairs);
+		world->triggerEvents = NULL;
+		world->triggerEventCount = 0;
+	}
+	if (world->checksumEnabled) world->stats.checksum = GetColliderWorldChecksum(world);
+	world->stats.mallocCount = CountWorldMallocs(world) - mallocsBefore;
+	world->stats.scratchBytes = world->scratch.used + world->scratch.overflowBytes;
+	for (int i = 0; i < world->threadScratchCount; i++) {
+		world->stats.scratchBytes += world->threadScratch[i].used + world->threadScratch[i].overflowBytes;
+	}
+}
+
+// FNV-1a, fed field by field so struct padding never reaches it
+static unsigned long long HashBytes(unsigned long long hash, const void* data, size_t size) {
+	const unsigned char* bytes = data;
+	for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+unsigned long long GetColliderWorldChecksum(ColliderWorld* world) {
+	unsigned long long hash = 0xcbf29ce484222325ull;
+	hash = HashBytes(hash, &world->count, sizeof(int));
+	hash = HashBytes(hash, &world->origin.x, sizeof(double));
+	hash = HashBytes(hash, &world->origin.y, sizeof(double));
+	hash = HashBytes(hash, &world->origin.z, sizeof(double));
+	for (int i = 0; i < world->count; i++) {
+		hash = HashBytes(hash, world->colliders[i].vertGlobal, sizeof(world->colliders[i].vertGlobal));
+		hash = HashBytes(hash, &world->slotHandle[i], sizeof(ColliderHandle));
+		hash = HashBytes(hash, &world->flags[i], sizeof(unsigned int));
+	}
+	for (int i = 0; i < world->contactCount; i++) {
+		ColliderContact* contact = &world->contacts[i];
+		hash = HashBytes(hash, &contact->a, sizeof(ColliderHandle));
+		hash = HashBytes(hash, &contact->b, sizeof(ColliderHandle));
+		hash = HashBytes(hash, &contact->correction, sizeof(Vector3));
+	}
+	for (int i = 0; i < world->triggerPairCount; i++) {
+		hash = HashBytes(hash, &world->triggerPairs[i].trigger, sizeof(ColliderHandle));
+		hash = HashBytes(hash, &world->triggerPairs[i].other, sizeof(ColliderHandle));
+	}
+
+	// Table order matters too, it decides the order of the next rehash
+	PairCache* cache = &world->pairCache;
+	for (int i = 0; i < cache->capacity; i++) {
+		PairCacheEntry* entry = &cache->entries[i];
+		if (entry->key == PAIR_CACHE_EMPTY) continue;
+		hash = HashBytes(hash, &i, sizeof(int));
+		hash = HashBytes(hash, &entry->key, sizeof(entry->key));
+		hash = HashBytes(hash, &entry->generation, sizeof(entry->generation));
+		hash = HashBytes(hash, &entry->firstGeneration, sizeof(entry->firstGeneration));
+		hash = HashBytes(hash, &entry->correction, sizeof(Vector3));
+	}
+	return hash;
+}
+
+void StepColliderWorld(ColliderWorld* world) {
+	StepWorld(world, world->pool, true);
+}
+
+void ResimulateColliderWorld(ColliderWorld* world) {
+	StepWorld(world, world->pool, false);
+}
+
+//*******************************************************************
+// Groups of worlds
+//*******************************************************************
+
+ColliderWorldGroup CreateColliderWorldGroup(ThreadPool* pool) {
+	return (ColliderWorldGroup) { .pool = pool };
+}
+
+void FreeColliderWorldGroup(ColliderWorldGroup* group) {
+	AllocatorFree(&group->allocator, group->worlds);
+	AllocatorFree(&group->allocator, group->order);
+	*group = (ColliderWorldGroup) { 0 };
+}
+
+void AddGroupWorld(ColliderWorldGroup* group, ColliderWorld* world) {
+	if (group->count == group->capacity) {
+		group->capacity = group->capacity ? group->capacity * 2 : 64;
+		group->worlds = AllocatorRealloc(&group->allocator, group->worlds, sizeof(ColliderWorld*) * group->capacity);
+		group->order = AllocatorRealloc(&group->allocator, group->order, sizeof(WorldCost) * group->capacity);
+	}
+	group->worlds[group->count++] = world;
+}
+
+// Order of the rest does not matter, so the last world fills the hole
+void RemoveGroupWorld(ColliderWorldGroup* group, ColliderWorld* world) {
+	for (int i = 0; i < group->count; i++) {
+		if (group->worlds[i] != world) continue;
+		group->worlds[i] = group->worlds[--group->count];
+		return;
+	}
+}
+
+static int CompareWorldCosts(const void* a, const void* b) {
+	const WorldCost* ca = a;
+	const WorldCost* cb = b;
+	if (ca->cost != cb->cost) return ca->cost > cb->cost ? -1 : 1;
+	return ca->world - cb->world;
+}
+
+// One world per task, stepped serially on whichever thread claims it
+static void RunWorldGroup(int begin, int end, int thread, void* user) {
+	(void) thread;
+	ColliderWorldGroup* group = user;
+	for (int i = begin; i < end; i++) StepWorld(group->worlds[group->order[i].world], NULL, true);
+}
+
+void StepColliderWorldGroup(ColliderWorldGroup* group) {
+	// Biggest first: threads claim worlds in this order, so the large
+	// ones start early and the small ones fill in the gaps at the end
+	for (int i = 0; i < group->count; i++) {
+		ColliderWorld* world = group->worlds[i];
+		group->order[i] = (WorldCost) { world->count + world->pairCount, i };
+	}
+	if (group->count > 1) qsort(group->order, group->count, sizeof(WorldCost), CompareWorldCosts);
+	ThreadPoolFor(group->pool, group->count, 1, RunWorldGroup, group);
+}
@@ -0,0 +1,387 @@
+// 
+// Collection of colliders with broadphase and contact generation
+//
+// 2023, Jonathan Tainer
+//
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "collider.h"
+#include "allocator.h"
+#include "arena.h"
+#include "hgrid.h"
+#include "paircache.h"
+#include "threadpool.h"
+
+typedef struct ColliderCommandQueue ColliderCommandQueue;
+typedef struct ColliderSnapshots ColliderSnapshots;
+
+// Stable identity of a collider in a world, unaffected by reordering.
+// The low bits index the handle table and the high bits hold the
+// generation of that entry, which changes every time it is freed, so
+// handles to removed colliders are detected instead of aliasing new ones.
+typedef unsigned int ColliderHandle;
+
+#define COLLIDER_HANDLE_INVALID 0xFFFFFFFFu
+#define COLLIDER_HANDLE_INDEX_BITS 20
+#define COLLIDER_HANDLE_INDEX_MASK ((1u << COLLIDER_HANDLE_INDEX_BITS) - 1)
+
+// Index is all ones only in the invalid handle
+#define COLLIDER_HANDLE_MAX_INDEX (COLLIDER_HANDLE_INDEX_MASK - 1)
+
+// Steps between Morton reorders unless changed on the world
+#define COLLIDER_WORLD_REORDER_INTERVAL 64
+
+// Colliders only collide if each one's category is in the other's mask.
+// A shared positive group always collides and a shared negative group
+// never does, whatever the masks say.
+typedef struct ColliderFilter {
+	unsigned int category;
+	unsigned int mask;
+	int group;
+} ColliderFilter;
+
+#define COLLIDER_FILTER_DEFAULT ((ColliderFilter) { 1u, 0xFFFFFFFFu, 0 })
+
+// Per collider flags
+#define COLLIDER_FLAG_TRIGGER 0x1u
+
+// Overlapping pair of colliders, by storage slot
+typedef struct ColliderPair {
+	int a;
+	int b;
+
+	// Filled in by the narrowphase
+	bool touching;
+	Vector3 correction;
+} ColliderPair;
+
+// Result of the narrowphase for one overlapping pair
+typedef struct ColliderContact {
+	ColliderHandle a;
+	ColliderHandle b;
+
+	// Translation that resolves the overlap when added to 'a'
+	Vector3 correction;
+} ColliderContact;
+
+// Trigger overlap, by handle so it can be compared across steps. When
+// both colliders are triggers the smaller handle is 'trigger'.
+typedef struct TriggerPair {
+	ColliderHandle trigger;
+	ColliderHandle other;
+} TriggerPair;
+
+typedef enum TriggerEventType {
+	TRIGGER_BEGIN,
+	TRIGGER_STAY,
+	TRIGGER_END,
+} TriggerEventType;
+
+typedef struct TriggerEvent {
+	TriggerEventType type;
+	ColliderHandle trigger;
+	ColliderHandle other;
+} TriggerEvent;
+
+// Instrumentation for the last step
+typedef struct ColliderWorldStats {
+	// Heap allocations made during the step, zero once the world has warmed up
+	int mallocCount;
+
+	// Scratch memory used by all threads
+	size_t scratchBytes;
+
+	// GetColliderWorldChecksum after the step, if checksums are enabled
+	unsigned long long checksum;
+} ColliderWorldStats;
+
+// Transforms read in place from caller arrays, such as ECS component
+// storage. Strides are in bytes, zero means tightly packed. Rotations
+// may be NULL to keep each collider's current rotation. Transforms of
+// attached colliders are relative to their parent.
+typedef struct ColliderTransformBatch {
+	const ColliderHandle* handles;
+	size_t handleStride;
+
+	const Vector3* positions;
+	size_t positionStride;
+
+	const Quaternion* rotations;
+	size_t rotationStride;
+
+	int count;
+} ColliderTransformBatch;
+
+// Bytes of heap memory held by each part of a world
+typedef struct ColliderMemoryReport {
+	// Per collider state other than geometry: transforms, bounds, filters, handles
+	size_t colliders;
+
+	// Local space geometry of each collider
+	size_t shapes;
+
+	size_t broadphase;
+	size_t pairCache;
+	size_t scratch;
+	size_t snapshots;
+
+	// Queue attached as world->commands, if any
+	size_t commands;
+	size_t total;
+} ColliderMemoryReport;
+
+// Point in application coordinates, in doubles so it stays exact far
+// beyond the range where floats keep sub-millimeter precision
+typedef struct ColliderOrigin {
+	double x;
+	double y;
+	double z;
+} ColliderOrigin;
+
+typedef struct ColliderWorld {
+	// Dense storage, sorted along a Morton curve every few steps so
+	// colliders near each other in space are near each other in memory
+	Collider* colliders;
+	BoundingBox* bounds;
+	ColliderFilter* filters;
+	unsigned int* flags;
+	ColliderHandle* slotHandle;
+	int count;
+	int capacity;
+
+	// Indirection from handle index to current storage slot. Free
+	// entries hold the index of the next free entry instead.
+	int* handleSlot;
+	unsigned int* handleGeneration;
+	int handleCount;
+	int handleCapacity;
+	int freeHandle;
+
+	// Parent links, indexed by handle index like the handle table so
+	// they survive reordering. Attached colliders are placed by their
+	// transform relative to the parent.
+	ColliderHandle* parentHandle;
+	int* childCount;
+	Matrix* localTransform;
+
+	// Set when a collider moves, cleared once its children have followed
+	bool* transformDirty;
+
+	// Colliders handed out by GetWorldCollider since the last step, whose
+	// bounds and broadphase entries are refreshed when the next one starts.
+	// The flag, by handle index, keeps each handle in the list once.
+	bool* handleMoved;
+	ColliderHandle* movedHandles;
+	int movedCount;
+	int movedCapacity;
+
+	// Attached colliders with parents before children, rebuilt when links change
+	ColliderHandle* hierarchyOrder;
+	int hierarchyCount;
+	int hierarchyCapacity;
+	bool hierarchyChanged;
+
+	// Application coordinates of the world's zero. Colliders are stored
+	// relative to it, and rebasing moves it to keep them near zero.
+	ColliderOrigin origin;
+
+	// Broadphase ids are storage slots
+	HashGrid broadphase;
+
+	// Runs the narrowphase in parallel if set
+	ThreadPool* pool;
+
+	// Edits from other threads, applied at the start of each step if set
+	ColliderCommandQueue* commands;
+
+	// Read only copies for other threads, published after each step
+	// once enabled with EnableWorldSnapshots
+	ColliderSnapshots* snapshots;
+
+	// State that persists for as long as a pair keeps overlapping
+	PairCache pairCache;
+
+	// Per-step temporaries for the stepping thread and for each pool
+	// thread, all released at once when the next step begins
+	Arena scratch;
+	Arena* threadScratch;
+	int threadScratchCount;
+
+	// Overlapping pairs sorted by slot, in scratch memory
+	ColliderPair* pairs;
+	int pairCount;
+	int pairCapacity;
+
+	// Narrowphase output of the last step, in scratch memory
+	ColliderContact* contacts;
+	int contactCount;
+
+	// Trigger overlaps of this step and the last, sorted by handle
+	TriggerPair* triggerPairs;
+	int triggerPairCount;
+	int triggerPairCapacity;
+	TriggerPair* prevTriggerPairs;
+	int prevTriggerPairCount;
+	int prevTriggerPairCapacity;
+
+	// Differences between the two sets of trigger overlaps, in scratch memory
+	TriggerEvent* triggerEvents;
+	int triggerEventCount;
+
+	// Compute stats.checksum at the end of every step
+	bool checksumEnabled;
+
+	// Zero disables automatic reordering
+	int reorderInterval;
+	int stepsSinceReorder;
+
+	// Every allocation made by the world and its parts goes through here
+	ColliderAllocator allocator;
+
+	// Heap allocations ever made for storage owned directly by the world
+	int mallocCount;
+	ColliderWorldStats stats;
+} ColliderWorld;
+
+// Cell size should be about the size of the smallest colliders
+ColliderWorld* CreateColliderWorld(float cellSize);
+
+// Same as above, with all memory coming from the given allocator. NULL
+// if only some of its callbacks are set.
+ColliderWorld* CreateColliderWorldEx(float cellSize, ColliderAllocator allocator);
+
+void FreeColliderWorld(ColliderWorld* world);
+
+// Bytes currently held by the world, broken down by purpose
+ColliderMemoryReport GetColliderWorldMemory(ColliderWorld* world);
+
+// Copies the collider into the world, returns COLLIDER_HANDLE_INVALID
+// if every handle is in use
+ColliderHandle AddWorldCollider(ColliderWorld* world, Collider col);
+
+// Moves the last collider into the removed one's slot, so storage stays
+// packed at constant cost. Cached pairs with the collider are dropped at
+// the next step, which also reports end events for triggers it was in.
+// Returns false if the handle is stale.
+bool RemoveWorldCollider(ColliderWorld* world, ColliderHandle handle);
+
+// False once the collider has been removed
+bool IsWorldColliderValid(ColliderWorld* world, ColliderHandle handle);
+
+// Pointer is valid until the next step, add or remove, since storage may
+// move. NULL if the handle is stale or the world is a read only view. The
+// collider may be moved through it, so its bounds and broadphase entry
+// are refreshed at the next step.
+Collider* GetWorldCollider(ColliderWorld* world, ColliderHandle handle);
+
+// Same as above for reading only. Nothing is marked for the next step, so
+// it works on snapshots and scene views and from several threads at once.
+Collider* PeekWorldCollider(ColliderWorld* world, ColliderHandle handle);
+
+// Filters are checked as pairs come out of the broadphase, so
+// filtered pairs never reach the narrowphase
+void SetWorldColliderFilter(ColliderWorld* world, ColliderHandle handle, ColliderFilter filter);
+
+ColliderFilter GetWorldColliderFilter(ColliderWorld* world, ColliderHandle handle);
+
+// Triggers report overlaps as events but never produce contacts
+void SetWorldColliderTrigger(ColliderWorld* world, ColliderHandle handle, bool trigger);
+
+// Set transforms, bounds and broadphase entries of many colliders at
+// once, in parallel on the world's pool if it has one. Each handle may
+// appear only once per batch, stale handles are skipped.
+void SetWorldTransformBatch(ColliderWorld* world, ColliderTransformBatch batch);
+
+// Attach a collider to a parent, keeping its current placement, or
+// detach it with COLLIDER_HANDLE_INVALID. Fails if either handle is
+// stale or the link would make a cycle.
+bool SetWorldColliderParent(ColliderWorld* world, ColliderHandle handle, ColliderHandle parent);
+
+ColliderHandle GetWorldColliderParent(ColliderWorld* world, ColliderHandle handle);
+
+// Global transform, also marks the collider so its children follow.
+// Bounds and the broadphase are updated right away. Moving a parent
+// through GetWorldCollider does not move its children.
+void SetWorldColliderTransform(ColliderWorld* world, ColliderHandle handle, Matrix transform);
+
+// Transform relative to the parent, or global for unattached colliders
+void SetWorldColliderLocalTransform(ColliderWorld* world, ColliderHandle handle, Matrix transform);
+
+// Place attached colliders whose parent or own transform changed since
+// the last update, called at the start of every step
+void UpdateWorldHierarchy(ColliderWorld* world);
+
+// Sort storage by Morton code of each collider's center
+void ReorderColliderWorld(ColliderWorld* world);
+
+// Move the origin by the shift and every collider by the opposite, in
+// one pass on the world's pool, then rebuild the broadphase. Contacts,
+// cached pairs and trigger state are unaffected. Positions kept outside
+// the world, such as a ColliderHistory, must be shifted to match.
+void RebaseColliderWorld(ColliderWorld* world, Vector3 shift);
+
+// Rebase onto the focus, snapped to whole broadphase cells, once it is
+// farther than the distance from zero. Returns true if it did.
+bool RebaseColliderWorldAround(ColliderWorld* world, Vector3 focus, float distance);
+
+// Copy everything the next step depends on: colliders, handles, the
+// origin, the hierarchy, the broadphase, the pair cache and the trigger baseline.
+// Only grows memory when dst is smaller than src, so copying between
+// worlds of the same size is a series of memcpys. Results of the last
+// step, settings and attached pools and queues are left alone.
+void CopyColliderWorldState(ColliderWorld* dst, ColliderWorld* src);
+
+// Apply queued commands, refresh bounds of colliders moved through
+// GetWorldCollider, find overlapping pairs and compute a contact for
+// each, or a trigger event if either collider is a trigger. Pairs,
+// contacts and events stay valid until the next step.
+void StepColliderWorld(ColliderWorld* world);
+
+// Hash of the simulation state and the last step's results. Steps are
+// bit identical for any number of threads, so equal checksums across
+// runs with different pools mean the runs did not diverge.
+unsigned long long GetColliderWorldChecksum(ColliderWorld* world);
+
+// Step again after a rollback. Contacts are produced as usual, but
+// queued commands are not applied, trigger events are not reported and
+// no snapshot is published, since all of those already happened the
+// first time through.
+void ResimulateColliderWorld(ColliderWorld* world);
+
+// Cost estimate of stepping a world, from its last step
+typedef struct WorldCost {
+	int cost;
+	int world;
+} WorldCost;
+
+// Many small worlds, such as one per match on a server, stepped
+// together. Each world is a single task on the shared pool, which is
+// cheaper than splitting a few hundred colliders across threads.
+typedef struct ColliderWorldGroup {
+	ColliderWorld** worlds;
+	int count;
+	int capacity;
+
+	// Step order, most expensive world first
+	WorldCost* order;
+
+	ThreadPool* pool;
+	ColliderAllocator allocator;
+} ColliderWorldGroup;
+
+ColliderWorldGroup CreateColliderWorldGroup(ThreadPool* pool);
+
+void FreeColliderWorldGroup(ColliderWorldGroup* group);
+
+// Worlds are not owned by the group. Their own pools are ignored while
+// the group steps them.
+void AddGroupWorld(ColliderWorldGroup* group, ColliderWorld* world);
+
+void RemoveGroupWorld(ColliderWorldGroup* group, ColliderWorld* world);
+
+// Step every world once, in parallel across the group's pool
+void StepColliderWorldGroup(ColliderWorldGroup* group);
+
+#endif